@@ -3,32 +3,101 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "shader.h"
 #include "camera.h"
+#include "lights.h"
+#include "clustered_lights.h"
 
 #include <iostream>
 
-#include "cylinder.h"
-#include "Sphere.h"
+#include "meshes.h"
+#include "mesh_cache.h"
+#include "mesh_pool.h"
+#include "multi_draw.h"
+#include "render_queue.h"
+#include "scene.h"
+#include "instancing.h"
+#include "texture_array.h"
+#include "texture_loader.h"
+#include "camera_path.h"
+#include "headless.h"
+#include "frame_capture.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "culling.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "frame_pipeline.h"
+#include "job_system.h"
+#include "shadows.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
-void createCube(unsigned int& vbo, unsigned int& vao, float posX, float posY, float posZ);
+unsigned int processInput(GLFWwindow* window);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-unsigned int loadTexture(const char* path);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 const char* WINDOW_TITLE = "David France Final Project";
+const char* DEFAULT_SCENE = "scenes/table_scene.txt";
+// false skips flipping every image on load, the shader flips the texture coordinates instead
+const bool FLIP_IMAGES_ON_LOAD = false;
+// headless batch rendering: frames are rendered at a fixed rate along the camera path
+const int DEFAULT_HEADLESS_FRAMES = 120;
+const float HEADLESS_FRAME_RATE = 30.0f;
+const char* DEFAULT_FRAME_DIRECTORY = "frames";
+// benchmark mode: replays this recording offscreen over the scene (optionally replicated) and
+// gates the frame times against a baseline results file
+const char* DEFAULT_BENCHMARK_INPUT = "scenes/bench_input.txt";
+const char* DEFAULT_BENCHMARK_RESULTS = "bench_results.txt";
+// distance between copies of the table when the scene is scaled up
+const float SCENE_COPY_SPACING = 3.0f;
+// a left click picks the closest object under the center of the screen up to this far away
+const float PICK_DISTANCE = 100.0f;
+// draws sort front to back over this view depth (the far plane)
+const float SORT_DEPTH_RANGE = 100.0f;
+
+// command line options, see parseOptions()
+struct Options
+{
+	const char* scenePath = DEFAULT_SCENE;
+	bool headless = false;
+	int frames = DEFAULT_HEADLESS_FRAMES;
+	int width = SCR_WIDTH;
+	int height = SCR_HEIGHT;
+	const char* cameraPath = NULL;
+	std::string outputDirectory = DEFAULT_FRAME_DIRECTORY;
+	const char* profilePath = NULL;
+	int scale = 1;
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	bool benchmark = false;
+	const char* baselinePath = NULL;
+	const char* resultsPath = DEFAULT_BENCHMARK_RESULTS;
+	float threshold = BENCHMARK_DEFAULT_THRESHOLD;
+	Vertex_Format vertexFormat = VERTEX_FORMAT_PACKED;
+	bool depthPrepass = false;
+	bool occlusionCulling = false;
+};
+bool parseOptions(int argc, char** argv, Options& options);
 
 // camera
 Camera camera(glm::vec3(-0.75f, 0.5f, 0.75f));
@@ -39,6 +108,8 @@ bool firstMouse = true;
 // projection matrix
 glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 bool perspective = true;
+// height of what we render into in pixels, levels of detail are picked for it
+int framebufferHeight = SCR_HEIGHT;
 
 // timing
 float deltaTime = 0.0f;
@@ -52,63 +123,75 @@ GLuint sphereIndexByteOffset;
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-// Flip images for texturing
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-	for (int j = 0; j < height / 2; ++j)
-	{
-		int index1 = j * width * channels;
-		int index2 = (height - 1 - j) * width * channels;
+// profiler overlay, toggled with F1
+bool showProfiler = false;
 
-		for (int i = width * channels; i > 0; --i)
-		{
-			unsigned char tmp = image[index1];
-			image[index1] = image[index2];
-			image[index2] = tmp;
-			++index1;
-			++index2;
-		}
-	}
-}
+// set by a left click, the pick ray is cast from the camera in the next frame
+bool pickRequested = false;
 
-int main()
-{
-	// glfw: initialize and configure
-	// ------------------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// mouse movement since the last frame, for input recording
+float frameMouseX = 0.0f;
+float frameMouseY = 0.0f;
+// set while a recording drives the camera, mouse and movement keys are ignored
+bool replayingInput = false;
 
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+		return -1;
+	const char* scenePath = options.scenePath;
 
-	// glfw window creation
-	// --------------------
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, WINDOW_TITLE, NULL, NULL);
-	if (window == NULL)
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	if (options.headless)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		// no window: an EGL/OSMesa context that renders into an offscreen framebuffer
+		if (!headlessContext.create())
+			return -1;
+		framebufferHeight = options.height;
 	}
-	// Register key, mouse, and window callbacks
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-	glfwSetKeyCallback(window, keyCallback);
-
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-	// glad: load all OpenGL function pointers
-	// ---------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	else
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		// glfw: initialize and configure
+		// ------------------------------
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+		// glfw window creation
+		// --------------------
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, WINDOW_TITLE, NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		// Register key, mouse, and window callbacks
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwGetFramebufferSize(window, NULL, &framebufferHeight);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetKeyCallback(window, keyCallback);
+		glfwSetMouseButtonCallback(window, mouseButtonCallback);
+
+		// tell GLFW to capture our mouse
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+		// glad: load all OpenGL function pointers
+		// ---------------------------------------
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
 	}
 
 	// configure global opengl state
@@ -117,317 +200,773 @@ int main()
 
 	// build and compile our shader zprogram
 	// ------------------------------------
-	Shader lightingShader("shaderfiles/6.multiple_lights.vs", "shaderfiles/6.multiple_lights.fs");
-	Shader lightCubeShader("shaderfiles/6.light_cube.vs", "shaderfiles/6.light_cube.fs");
-
-	// set up vertex data (and buffer(s)) and configure vertex attributes
-	float tableVertices[] = {
-		-0.5f, 0.0f, -0.5f,  0.0f,  0.0f, 1.0f,  0.0f,  1.0f,
-		 0.5f, 0.0f, -0.5f,  0.0f,  0.0f, 1.0f,  1.0f,  1.0f,
-		 0.5f, 0.0f,  0.5f,  0.0f,  0.0f, 1.0f,  1.0f,  0.0f,
-		 0.5f, 0.0f,  0.5f,  0.0f,  0.0f, 1.0f,  1.0f,  0.0f,
-		-0.5f, 0.0f,  0.5f,  0.0f,  0.0f, 1.0f,  0.0f,  0.0f,
-		-0.5f, 0.0f, -0.5f,  0.0f,  0.0f, 1.0f,  0.0f,  1.0f,
-	};
-	// Table is positioned at the center
-	glm::vec3 tablePosition = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// Positions of the point lights
-	glm::vec3 pointLightPositions[] = {
-		glm::vec3(-1.5f,  1.0f,  0.0f),
-		glm::vec3(-1.5f,  1.0f,  3.0f),
-		glm::vec3(-1.5f,  1.0f, -4.5f)
-	};
-	// Configure the table's VAO (and VBO)
-	unsigned int tableVBO, tableVAO;
-	glGenVertexArrays(1, &tableVAO);
-	glGenBuffers(1, &tableVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, tableVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(tableVertices), tableVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(tableVAO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-
-	// Set up cutting board VAO, VBO, and position
-	glm::vec3 cuttingBoardPosition = glm::vec3(0.0f, 0.001f, 0.0f);
-	unsigned int cuttingBoardVBO, cuttingBoardVAO;
-	createCube(cuttingBoardVBO, cuttingBoardVAO, 0.4f, 0.075f, 0.6f);
-
-	// Set up cheese block VAO, VBO, and position
-	glm::vec3 cheeseBlockPosition = glm::vec3(0.0f, 0.024f, -0.053f);
-	unsigned int cheeseBlockVBO, cheeseBlockVAO;
-	createCube(cheeseBlockVBO, cheeseBlockVAO, 0.15f, 0.25f, 0.125f);
-
-	// Set up cheese slice VAO, VBO, and positionglm::vec3 
-	glm::vec3 cheeseSlicePosition = glm::vec3(0.0f, 0.024f, 0.053f);
-	unsigned int cheeseSliceVBO, cheeseSliceVAO;
-	createCube(cheeseSliceVBO, cheeseSliceVAO, 0.15f, 0.025f, 0.125f);
-
-	// Set up positions for eggs
-	glm::vec3 eggPositions[] = {
-		glm::vec3(-0.33f, 0.036f, 0.23f),
-		glm::vec3(-0.35f, 0.036f, 0.10f),
-		glm::vec3(-0.25f, 0.036f, 0.13f)
-	};
-
-
-	// Create egg (sphere)
-	unsigned int eggVBO, eggVAO;
-	Sphere S(1, 30, 30);
-	glGenVertexArrays(1, &eggVAO);
-	glGenBuffers(1, &eggVBO);
-	glBindVertexArray(eggVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, eggVBO);
-
-	// Create bowl (empty cylinder
-	glm::vec3 bowlPosition = glm::vec3(-0.05f, 0.034f, 0.35f);
-	static_meshes_3D::Cylinder C(2, 100, 1, true, true, true);
-
-
-	// Configure the light's VAO (VBO stays the same - lights will be represented as a plane)
-	unsigned int lightCubeVAO;
-	glGenVertexArrays(1, &lightCubeVAO);
-	glBindVertexArray(lightCubeVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, tableVBO);
-	// note that we update the lamp's position attribute's stride to reflect the updated buffer data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	// Load textures - all images are my original pictures
-	unsigned int planeTexture = loadTexture("images/table.jpg");
-	unsigned int cuttingBoardTexture = loadTexture("images/cutting_board.jpg");
-	unsigned int cheeseTexture = loadTexture("images/cheese_slice.jpg");
-	unsigned int whiteEggTexture = loadTexture("images/white_egg1.jpg");
-	unsigned int greenEggTexture = loadTexture("images/green_egg.jpg");
-	unsigned int brownEggTexture = loadTexture("images/brown_egg.jpg");
-	unsigned int bowlTexture = loadTexture("images/bowl2.jpg");
-
-	// Egg texture array
-	unsigned int eggTextures[] = {
-		brownEggTexture,
-		whiteEggTexture,
-		greenEggTexture
-	};
+	// both read their model matrices from per instance attributes
+	Shader lightingShader("shaderfiles/6.multiple_lights_instanced.vs", "shaderfiles/6.multiple_lights.fs");
+	Shader lightCubeShader("shaderfiles/6.light_cube_instanced.vs", "shaderfiles/6.light_cube.fs");
+	Shader shadowShader("shaderfiles/shadow_depth.vs", "shaderfiles/depth_only.fs");
+	Shader prepassShader("shaderfiles/depth_prepass.vs", "shaderfiles/depth_only.fs");
+
+	// One worker per core besides this thread, shared by everything below that splits its CPU
+	// work into jobs: mesh generation, texture decoding, transforms, culling, light clusters
+	// and the visibility stage. This thread joins in whenever it waits for jobs.
+	JobSystem jobs;
+
+	// load the scene description (meshes, textures and the node hierarchy)
+	// ---------------------------------------------------------------------
+	Scene scene;
+	if (!scene.load(scenePath))
+	{
+		if (window)
+			glfwTerminate();
+		return -1;
+	}
+	// --scale N fills a grid with N copies of the table and everything on it
+	if (options.scale > 1)
+		std::cout << "Scaled scene to " << options.scale << " copies, " << scene.replicate(options.scale, SCENE_COPY_SPACING) << " nodes added" << std::endl;
+
+	// Create every mesh and texture the scene references once, nodes refer to them by index.
+	// Mesh entries with the same primitive and tessellation share one GPU mesh. Vertices are
+	// quantized to 16 bytes unless --vertex-format float asks for the full 32 byte floats.
+	// All of them share the buffers of one pool, so the scene draws without VAO switches.
+	// Their CPU copies are read or generated in parallel before the uploads.
+	MeshPool meshPool(options.vertexFormat);
+	MeshCache meshCache(meshPool, DEFAULT_MESH_DIRECTORY, &jobs);
+	std::vector<std::shared_ptr<Drawable>> meshes = meshCache.acquireAll(scene.meshes);
+	meshPool.upload();
+
+	// Every texture becomes a layer of one texture array, bound once for the whole lit pass.
+	// Layers are read from baked .ctex files (or decoded if there are none) in background jobs
+	// and show a placeholder until they are streamed in.
+	TextureLoader textureLoader(jobs, 2, FLIP_IMAGES_ON_LOAD);
+	std::unique_ptr<TextureArray> materials(new TextureArray(MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, (int)scene.textures.size()));
+	for (size_t i = 0; i < scene.textures.size(); i++)
+		textureLoader.loadLayer(*materials, (int)i, scene.textures[i].path.c_str());
+
+	// Every lamp node carries a point light, and the scene's light entries add more. lightNodes
+	// holds the node each point light follows.
+	std::vector<int> lightNodes;
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		if (scene.nodes[i].pass == PASS_LAMP)
+			lightNodes.push_back((int)i);
+	}
+	const size_t lampLights = lightNodes.size();
+	for (const LightDesc& light : scene.lights)
+		lightNodes.push_back(light.node);
+	scene.updateTransforms(&jobs);
+
+	// Nodes sharing mesh and pass form instanced batches. Their draws go through a render queue
+	// sorted by pass, shader, material, mesh and depth, and every run needing the same state is
+	// one glMultiDrawElementsIndirect. The instance data and the draw commands live in triple
+	// buffered, persistently mapped rings when the driver allows it.
+	std::vector<InstanceData> instances;
+	std::vector<InstanceBatch> batches;
+	std::vector<int> instanceNodes;
+	InstanceBuffer instanceBuffer;
+	MultiDrawBatcher multiDraw;
+	if (!multiDraw.usesIndirect())
+		std::cout << "Multi-draw indirect not supported, drawing every batch on its own" << std::endl;
+	buildInstanceBatches(scene, meshes, instances, batches, &instanceNodes);
+
+	// Shader and material numbers in the sort keys, per pass (PASS_NONE, PASS_LIT, PASS_LAMP).
+	// Material 0 binds nothing. The state cache drops binds of what is already bound.
+	Shader* const shaders[] = { &lightingShader, &lightCubeShader };
+	const GLuint materialTextures[] = { 0, materials->getTexture() };
+	const PassState passStates[] = { { 0, 0 }, { 0, 1 }, { 1, 0 } };
+	RenderStateCache renderState;
+	long long stateChanges = 0, stateChangesAvoided = 0;
+
+	// Only instances inside the view frustum are uploaded and drawn. The culler keeps a BVH over
+	// the node bounds, used for the frustum test and for picking. Culling reruns when the
+	// camera or the scene changed.
+	FrustumCuller culler;
+	culler.updateBounds(scene, meshes, &jobs);
+	glm::mat4 culledViewProjection(0.0f);
+	float culledViewportHeight = 0.0f;
+	bool instancesChanged = true;
+	int culledInstances = 0;
+	// --occlusion-culling: a Hi-Z pyramid of an earlier frame's depth also rejects hidden instances
+	std::unique_ptr<HiZBuffer> hiZ;
+	if (options.occlusionCulling)
+		hiZ.reset(new HiZBuffer());
+	int occludedInstances = 0;
+	bool hiZPending = false;
+	// spheres and cylinders switch to coarser tessellation as they get smaller on screen
+	LodSelector lodSelector;
+
+	// Shadow casters are every lit instance, not only the visible ones: things off screen still
+	// throw shadows into view. They have their own copy of the instance data and draw commands,
+	// rebuilt when the instances change, all at full detail.
+	InstanceBuffer casterBuffer;
+	MultiDrawBatcher casterDraw;
+	const PassState casterStates[] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
 
 	// shader configuration
 	// --------------------
 	lightingShader.use();
 	lightingShader.setInt("material.diffuse", 0);
 	lightingShader.setInt("material.specular", 1);
+	lightingShader.setFloat("material.shininess", 32.0f);
+	lightingShader.setBool("flipTexCoords", !textureLoader.flipsImages());
+	lightingShader.bindUniformBlock("Lighting", LIGHTING_UBO_BINDING);
+	// locations of the uniforms set every frame, so the render loop does no name lookups
+	const GLint lightingViewPos = lightingShader.getUniformLocation("viewPos");
+	const GLint lightingProjection = lightingShader.getUniformLocation("projection");
+	const GLint lightingView = lightingShader.getUniformLocation("view");
+	const GLint prepassProjection = prepassShader.getUniformLocation("projection");
+	const GLint prepassView = prepassShader.getUniformLocation("view");
+	const GLint lightCubeProjection = lightCubeShader.getUniformLocation("projection");
+	const GLint lightCubeView = lightCubeShader.getUniformLocation("view");
+
+	// Point lights on the lamps and the scene's lights, with one spotlight overhead. The point
+	// lights are sorted into view frustum clusters each frame so every pixel only evaluates the
+	// ones reaching it; the spotlight lives in a uniform buffer written once.
+	ClusteredLights clusters(&jobs);
+	LightingBuffer lights;
+	// lamp colors - white, soft yellow/white, white, repeating
+	const glm::vec3 pointLightSpecular[3] = {
+		glm::vec3(1.0f),
+		glm::vec3(0.9f, 1.0f, 0.8f),
+		glm::vec3(1.0f)
+	};
+	clusters.setPointLightCount((int)lightNodes.size());
+	for (size_t i = 0; i < lightNodes.size(); i++)
+	{
+		glm::vec3 position = scene.getWorldPosition(lightNodes[i]);
+		if (i < lampLights)
+			clusters.setPointLight((int)i, makePointLight(position, glm::vec3(0.05f), glm::vec3(0.8f), pointLightSpecular[i % 3]));
+		else
+			clusters.setPointLight((int)i, makePointLight(position, scene.lights[i - lampLights].color, scene.lights[i - lampLights].radius));
+	}
+	// spotLight - position fixed on top of the scene pointing down - color - soft yellow/white
+	lights.setSpotLight(makeSpotLight(glm::vec3(0.1f, 2.0f, 0.1f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(0.9f, 1.0f, 0.8f), 12.5f, 15.0f));
+
+	// Shadow maps for the spot light and the first point lights (the lamps come first). They are
+	// kept until their light or a caster in its reach moves.
+	ShadowMaps shadows;
+	shadows.setSpotLight(lights.getSpotLight());
+
+	// Headless runs render into an offscreen framebuffer along a scripted camera path and
+	// read every frame back for the PNG sequence
+	std::unique_ptr<RenderTarget> renderTarget;
+	std::unique_ptr<FrameCapture> frameCapture;
+	CameraPath cameraPath;
+	if (options.headless)
+	{
+		if (options.cameraPath)
+		{
+			if (!cameraPath.load(options.cameraPath))
+				return -1;
+		}
+		else
+		{
+			// one lap around the table over the whole run, at the interactive camera's distance and height
+			cameraPath.makeOrbit(glm::vec3(0.0f), 1.06f, 0.5f, options.frames / HEADLESS_FRAME_RATE);
+		}
 
+		renderTarget.reset(new RenderTarget(options.width, options.height));
+		// benchmarks only measure rendering, nothing is read back
+		if (!options.benchmark)
+		{
+			if (!options.outputDirectory.empty())
+				createOutputDirectory(options.outputDirectory);
+			frameCapture.reset(new FrameCapture(jobs, options.width, options.height, options.outputDirectory));
+		}
+		projection = glm::perspective(glm::radians(camera.Zoom), (float)options.width / (float)options.height, 0.1f, 100.0f);
 
-	// render loop
-	// -----------
-	while (!glfwWindowShouldClose(window))
+		// every frame should show the real textures, not the placeholders
+		textureLoader.finish();
+	}
+	// Frame profiler: CPU and GPU time of every pass and batch. --profile records the whole run and
+	// writes a Chrome trace at exit, F1 shows the graph overlay with the frame times in the title.
+	Profiler profiler;
+	std::unique_ptr<ProfilerOverlay> profilerOverlay;
+	const int updateScope = profiler.registerScope("update");
+	const int uniformScope = profiler.registerScope("lights and uniforms");
+	const int litPassScope = profiler.registerScope("lit pass");
+	const int lampPassScope = profiler.registerScope("lamp pass");
+	const int visibilityScope = profiler.registerScope("wait for visibility");
+	const int clusterScope = profiler.registerScope("light clusters");
+	const int shadowScope = profiler.registerScope("shadow maps");
+	const int prepassScope = profiler.registerScope("depth pre-pass");
+	const int hiZScope = profiler.registerScope("hi-z");
+	const int overlayScope = profiler.registerScope("overlay");
+	const int presentScope = profiler.registerScope(options.headless ? "capture" : "swap");
+	float lastTitleUpdate = 0.0f;
+
+	// Recorded camera input: --record saves the interactive controls, --replay (and --benchmark)
+	// drive the camera with a recording at a fixed time step instead
+	InputRecording inputRecording;
+	if (options.replayPath && !inputRecording.load(options.replayPath))
+		return -1;
+	replayingInput = options.replayPath != NULL;
+	int totalFrames = options.frames;
+	if (options.benchmark)
+	{
+		totalFrames = BENCHMARK_WARMUP_FRAMES + (int)inputRecording.frames.size();
+		profiler.setEnabled(true);
+	}
+	BenchmarkRun benchmarkRun;
+	long long lastGpuFrame = BENCHMARK_WARMUP_FRAMES - 1;
+	std::chrono::steady_clock::time_point lastFrameStart = std::chrono::steady_clock::now();
+
+	// The frame runs in three stages. Simulation (input, camera, transforms) and GL submission
+	// stay on the main thread, which owns the context. Visibility (culling, LOD selection,
+	// sorting and the draw lists) only reads the scene and the culler and writes its FrameData,
+	// so it runs as a job: while frame N is submitted, frame N + 1 is already being culled
+	// and sorted into the other FrameData.
+	FrameData frames[2];
+	JobCounter visibilityJob;
+	double visibilityTime = 0.0;
+	int visibilityFrames = 0;
+
+	// Simulation stage: advance the camera and the scene to frame index and record what the
+	// later stages need in frame
+	auto simulate = [&](FrameData& frame, int index)
 	{
-		// per-frame time logic
+		// per-frame time logic, headless frames advance by a fixed step
 		// --------------------
-		float currentFrame = glfwGetTime();
+		float currentFrame = options.headless ? index / HEADLESS_FRAME_RATE : (float)glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
 		// input
 		// -----
-		processInput(window);
+		if (options.replayPath)
+		{
+			// benchmarks hold the start position while warming up
+			int step = options.benchmark ? index - BENCHMARK_WARMUP_FRAMES : index;
+			if (step >= 0 && step < (int)inputRecording.frames.size())
+				inputRecording.apply(step, camera);
+			if (!options.headless)
+				processInput(window);
+		}
+		else if (options.headless)
+		{
+			cameraPath.apply(currentFrame, camera);
+		}
+		else
+		{
+			unsigned int keys = processInput(window);
+			if (options.recordPath)
+				inputRecording.record(deltaTime, keys, frameMouseX, frameMouseY);
+			frameMouseX = frameMouseY = 0.0f;
+		}
+
+		profiler.begin(updateScope);
+		// swap in any textures the loader threads finished since last frame
+		if (textureLoader.update() > 0)
+			renderState.invalidate();
+
+		// Only nodes that moved (and their children) get new matrices, and only then
+		// does the instance data need to be rebuilt and uploaded
+		frame.movedCasters.clear();
+		if (scene.updateTransforms(&jobs) > 0)
+		{
+			buildInstanceBatches(scene, meshes, instances, batches, &instanceNodes);
+			// shadows of moved casters go stale both where they were and where they are now
+			collectMovedCasters(scene, culler, frame.movedCasters);
+			culler.updateBounds(scene, meshes, &jobs);
+			collectMovedCasters(scene, culler, frame.movedCasters);
+			instancesChanged = true;
+		}
+
+		// the point lights follow their nodes
+		frame.lightPositions.resize(lightNodes.size());
+		for (size_t i = 0; i < lightNodes.size(); i++)
+			frame.lightPositions[i] = scene.getWorldPosition(lightNodes[i]);
+		// a new occlusion pyramid arrived, culling has to run again even if nothing moved
+		bool occlusionChanged = hiZ && hiZ->update();
+		profiler.end();
+
+		// the cursor is captured, so the pick ray goes straight out of the center of the view
+		if (pickRequested)
+		{
+			float distance = 0.0f;
+			int picked = culler.pick(camera.Position, camera.Front, PICK_DISTANCE, &distance);
+			if (picked >= 0)
+				std::cout << "Picked " << scene.nodes[picked].name << " at " << distance << std::endl;
+			else
+				std::cout << "Picked nothing" << std::endl;
+			pickRequested = false;
+		}
+
+		frame.view = camera.GetViewMatrix();
+		frame.projection = projection;
+		frame.viewProjection = projection * frame.view;
+		frame.eye = camera.Position;
+		frame.forward = camera.Front;
+		frame.viewportHeight = (float)framebufferHeight;
+		frame.viewChanged = instancesChanged || frame.viewProjection != culledViewProjection || frame.viewportHeight != culledViewportHeight;
+		frame.visibilityChanged = frame.viewChanged || occlusionChanged;
+		frame.instancesChanged = instancesChanged;
+		if (instancesChanged)
+		{
+			frame.casterInstances = instances;
+			frame.casterBatches = batches;
+		}
+		culledViewProjection = frame.viewProjection;
+		culledViewportHeight = frame.viewportHeight;
+		instancesChanged = false;
+	};
+
+	// Visibility stage: skip everything outside the view frustum (or hidden, with occlusion
+	// culling) and turn the rest into sorted draw lists. No GL calls, this runs as a job.
+	auto buildVisibility = [&](FrameData& frame)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (frame.instancesChanged)
+		{
+			frame.casterBatches.erase(std::remove_if(frame.casterBatches.begin(), frame.casterBatches.end(),
+				[](const InstanceBatch& batch) { return batch.pass != PASS_LIT; }), frame.casterBatches.end());
+			MultiDrawBatcher::queueBatches(frame.casterQueue, frame.casterBatches, frame.casterInstances, casterStates, frame.eye, frame.forward, SORT_DEPTH_RANGE);
+			MultiDrawBatcher::buildDrawList(frame.casterQueue, frame.casterBatches, meshes, frame.casterDraws);
+		}
+
+		Frustum frustum;
+		frustum.extract(frame.viewProjection);
+		frame.culledInstances = culler.cull(frustum, instanceNodes, frame.visible);
+		frame.occludedInstances = 0;
+		if (hiZ)
+		{
+			std::atomic<int> occluded(0);
+			jobs.parallelFor(0, instanceNodes.size(), OCCLUSION_TEST_GRAIN, [&](size_t first, size_t last) {
+				int count = 0;
+				for (size_t i = first; i < last; i++)
+				{
+					if (frame.visible[i] && hiZ->isOccluded(culler.getWorldBox(instanceNodes[i])))
+					{
+						frame.visible[i] = 0;
+						count++;
+					}
+				}
+				occluded += count;
+			});
+			frame.occludedInstances = occluded;
+			frame.culledInstances += frame.occludedInstances;
+		}
+		lodSelector.select(scene, meshes, culler, instanceNodes, frame.visible, frame.projection, frame.viewProjection,
+			frame.viewportHeight, frame.lods, &jobs);
+		compactVisibleInstances(instances, batches, frame.visible, frame.lods, frame.visibleInstances, frame.visibleBatches);
+		MultiDrawBatcher::queueBatches(frame.queue, frame.visibleBatches, frame.visibleInstances, passStates, frame.eye, frame.forward, SORT_DEPTH_RANGE);
+		MultiDrawBatcher::buildDrawList(frame.queue, frame.visibleBatches, meshes, frame.draws);
+		frame.visibilityTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
+	int frameIndex = 0;
+
+	// the first frame has nobody to overlap with
+	simulate(frames[0], 0);
+	buildVisibility(frames[0]);
+
+	// render loop
+	// -----------
+	while (options.headless ? frameIndex < totalFrames : !glfwWindowShouldClose(window))
+	{
+		profiler.setEnabled(options.benchmark || options.profilePath != NULL || showProfiler);
+		profiler.beginFrame();
+		renderState.beginFrame();
+		int drawCalls = 0;
+		long long triangles = 0;
+		if (options.headless)
+			renderTarget->bind();
+
+		// Simulate the next frame and start its visibility stage, it runs while this one is submitted
+		FrameData& frame = frames[frameIndex % 2];
+		FrameData& nextFrame = frames[(frameIndex + 1) % 2];
+		if (!options.headless || frameIndex + 1 < totalFrames)
+		{
+			simulate(nextFrame, frameIndex + 1);
+			if (nextFrame.visibilityChanged)
+			{
+				FrameData* target = &nextFrame;
+				// a worker's job: if this thread could pick it up while waiting for its own jobs
+				// during submission, the two frames would not overlap
+				jobs.runInBackground(visibilityJob, [&buildVisibility, target]() { buildVisibility(*target); }, true);
+			}
+		}
+
+		// GL submission of this frame: its lights, moved casters and draw lists first
+		for (size_t i = 0; i < lightNodes.size(); i++)
+		{
+			PointLight light = clusters.getPointLight((int)i);
+			light.position = frame.lightPositions[i];
+			clusters.setPointLight((int)i, light);
+			if (i < (size_t)MAX_SHADOWED_POINT_LIGHTS)
+				shadows.setPointLight((int)i, (int)i, light);
+		}
+		for (const BoundingBox& box : frame.movedCasters)
+			shadows.invalidate(box);
+		if (frame.instancesChanged)
+		{
+			casterBuffer.upload(frame.casterInstances);
+			casterDraw.upload(frame.casterDraws);
+		}
+		if (frame.visibilityChanged)
+		{
+			instanceBuffer.upload(frame.visibleInstances);
+			multiDraw.upload(frame.draws);
+			culledInstances = frame.culledInstances;
+			occludedInstances = frame.occludedInstances;
+			visibilityTime += frame.visibilityTime;
+			visibilityFrames++;
+		}
+		const glm::mat4& view = frame.view;
+		const glm::mat4& frameProjection = frame.projection;
+
+		// Shadow maps first, only those that went out of date. Casters draw through the same pool
+		// VAO, with the instanced attributes pointed at the unculled copy.
+		{
+			ProfileScope scope(profiler, shadowScope);
+			if (shadows.needsRender())
+			{
+				renderState.useProgram(shadowShader.ID);
+				renderState.bindVertexArray(meshPool.getVAO());
+				casterBuffer.bind(0);
+				shadows.render(shadowShader.ID, [&]() {
+					for (const DrawGroup& group : casterDraw.getGroups())
+					{
+						drawCalls += casterDraw.draw(group, meshPool, casterBuffer);
+						triangles += group.triangles;
+					}
+				});
+			}
+		}
 
 		// render
 		// ------
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Activate shader when setting uniforms/drawing objects
-		lightingShader.use();
-		lightingShader.setVec3("viewPos", camera.Position);
-		lightingShader.setFloat("material.shininess", 32.0f);
-
-		// Set up three point lights and one spotlight to represent distant point lights with one overhead light
-		// point light 1 - color - white
-		lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-		lightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[0].constant", 1.0f);
-		lightingShader.setFloat("pointLights[0].linear", 0.09);
-		lightingShader.setFloat("pointLights[0].quadratic", 0.032);
-		// point light 2 - color - soft yellow/white
-		lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-		lightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].specular", 0.9f, 1.0f, 0.8f);
-		lightingShader.setFloat("pointLights[1].constant", 1.0f);
-		lightingShader.setFloat("pointLights[1].linear", 0.09);
-		lightingShader.setFloat("pointLights[1].quadratic", 0.032);
-		// point light 3 - color - white
-		lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-		lightingShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[2].constant", 1.0f);
-		lightingShader.setFloat("pointLights[2].linear", 0.09);
-		lightingShader.setFloat("pointLights[2].quadratic", 0.032);
-
-		// spotLight - position fixed on top of the scene pointing down - color - soft yellow/white
-		lightingShader.setVec3("spotLight.position", 0.1f, 2.0f, 0.1f);
-		lightingShader.setVec3("spotLight.direction", 0.0f, -1.0f, 0.0f);
-		lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("spotLight.specular", 0.9f, 1.0f, 0.8f);
-		lightingShader.setFloat("spotLight.constant", 1.0f);
-		lightingShader.setFloat("spotLight.linear", 0.09);
-		lightingShader.setFloat("spotLight.quadratic", 0.032);
-		lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+		profiler.begin(uniformScope);
+		// Uniforms stay with their program, so both shaders get theirs up front
+		renderState.useProgram(lightingShader.ID);
+		lightingShader.setVec3(lightingViewPos, frame.eye);
+
+		// Lights only reach the GPU when one of them (or for the clusters, the view) changed
+		lights.upload();
+		{
+			ProfileScope scope(profiler, clusterScope);
+			clusters.update(view, frameProjection);
+		}
+		clusters.setUniforms(lightingShader.ID);
+		shadows.setUniforms(lightingShader.ID);
 
 		// view/projection transformations
-		//glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
-
-		// world transformation
-		glm::mat4 model = glm::mat4(1.0f);
-		lightingShader.setMat4("model", model);
-
-		// Draw table
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, planeTexture);
-		glBindVertexArray(tableVAO);
-		// calculate the model matrix for each object and pass it to shader before drawing
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, tablePosition);
-		model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// Draw cutting board
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, cuttingBoardTexture);
-		glBindVertexArray(cuttingBoardVAO);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cuttingBoardPosition);
-		model = glm::scale(model, glm::vec3(0.3f));
-		model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// Draw cheese block
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, cheeseTexture);
-		glBindVertexArray(cheeseBlockVAO);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cheeseBlockPosition);
-		model = glm::scale(model, glm::vec3(0.3f));
-		model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// Draw cheese slice
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, cheeseTexture);
-		glBindVertexArray(cheeseSliceVAO);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cheeseSlicePosition);
-		model = glm::scale(model, glm::vec3(0.3f));
-		model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		
-		// Draw eggs
-		glBindVertexArray(eggVAO);
-		for (unsigned int i = 0; i < 3; i++)
-		{
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, eggTextures[i]);
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, glm::vec3(eggPositions[i]));
-			model = glm::scale(model, glm::vec3(0.035f));
-			model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			lightingShader.setMat4("model", model);
-
-			S.Draw();
-		}
-
-		// Draw bowl
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, bowlTexture);
-		glBindVertexArray(eggVAO);
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(bowlPosition));
-		model = glm::scale(model, glm::vec3(0.045f));
-		lightingShader.setMat4("model", model);
-		C.render();
-
-		// also draw the lamp object(s)
-		lightCubeShader.use();
-		lightCubeShader.setMat4("projection", projection);
-		lightCubeShader.setMat4("view", view);
-
-		// we now draw as many light bulbs as we have point lights.
-		glBindVertexArray(lightCubeVAO);
-		for (unsigned int i = 0; i < 3; i++)
-		{
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, pointLightPositions[i]);
-			model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-			lightCubeShader.setMat4("model", model);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		}
-
-
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		lightingShader.setMat4(lightingProjection, frameProjection);
+		lightingShader.setMat4(lightingView, view);
+		if (options.depthPrepass)
+		{
+			renderState.useProgram(prepassShader.ID);
+			prepassShader.setMat4(prepassProjection, frameProjection);
+			prepassShader.setMat4(prepassView, view);
+		}
+		renderState.useProgram(lightCubeShader.ID);
+		lightCubeShader.setMat4(lightCubeProjection, frameProjection);
+		lightCubeShader.setMat4(lightCubeView, view);
+		profiler.end();
+
+		// Draw the sorted groups, every mesh lives in the pool so its VAO is bound once. Lit
+		// objects pick their texture layer per instance; the lamps draw as many light bulbs
+		// as we have lamp nodes.
+		renderState.bindTexture(POINT_LIGHT_DATA_UNIT, GL_TEXTURE_BUFFER, clusters.getLightTexture());
+		renderState.bindTexture(CLUSTER_RANGES_UNIT, GL_TEXTURE_BUFFER, clusters.getRangeTexture());
+		renderState.bindTexture(CLUSTER_INDICES_UNIT, GL_TEXTURE_BUFFER, clusters.getIndexTexture());
+		renderState.bindTexture(SPOT_SHADOW_UNIT, GL_TEXTURE_2D, shadows.getSpotTexture());
+		renderState.bindTexture(POINT_SHADOW_UNIT, GL_TEXTURE_2D, shadows.getPointTexture());
+		renderState.bindVertexArray(meshPool.getVAO());
+		instanceBuffer.bind(0);
+		if (options.depthPrepass)
+		{
+			// --depth-prepass: lay down the lit objects' depth with a shader that does nothing
+			// else, then the lit pass only shades the closest surface of every pixel
+			ProfileScope scope(profiler, prepassScope);
+			renderState.useProgram(prepassShader.ID);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			for (const DrawGroup& group : multiDraw.getGroups())
+			{
+				if (group.pass != PASS_LIT)
+					continue;
+				drawCalls += multiDraw.draw(group, meshPool, instanceBuffer);
+				triangles += group.triangles;
+			}
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_LEQUAL);
+		}
+		for (const DrawGroup& group : multiDraw.getGroups())
+		{
+			ProfileScope passScope(profiler, group.pass == PASS_LAMP ? lampPassScope : litPassScope);
+			renderState.useProgram(shaders[group.shader]->ID);
+			if (group.material > 0)
+				renderState.bindTexture(0, GL_TEXTURE_2D_ARRAY, materialTextures[group.material]);
+			drawCalls += multiDraw.draw(group, meshPool, instanceBuffer);
+			triangles += group.triangles;
+		}
+		if (options.depthPrepass)
+			glDepthFunc(GL_LESS);
+		// every draw reading the instance data and commands is queued, fence them before reuse
+		instanceBuffer.endFrame();
+		multiDraw.endFrame();
+		casterBuffer.endFrame();
+		casterDraw.endFrame();
+
+		// the next frame's visibility has to be done before anything it reads changes
+		{
+			ProfileScope scope(profiler, visibilityScope);
+			jobs.wait(visibilityJob);
+		}
+
+		// The finished depth becomes the next occlusion pyramid. Only after the view or the
+		// instances changed: culling against the pyramid does not change the depth, so the
+		// pyramid it would give is the one we have. Not before the wait, the visibility job reads it.
+		// A build skipped because the readbacks are all still in flight is retried next frame.
+		if (hiZ && (frame.viewChanged || hiZPending))
+		{
+			ProfileScope scope(profiler, hiZScope);
+			hiZPending = !hiZ->build(frame.viewProjection);
+			renderState.invalidate();
+		}
+
+		if (showProfiler && !options.headless)
+		{
+			ProfileScope scope(profiler, overlayScope);
+			if (!profilerOverlay)
+				profilerOverlay.reset(new ProfilerOverlay());
+			profilerOverlay->draw(profiler);
+			renderState.invalidate();
+
+			// no text in the overlay, the latest numbers go in the title twice a second
+			const ProfileFrame* last = profiler.getLastResolvedFrame();
+			if (last && !last->samples.empty() && lastFrame - lastTitleUpdate > 0.5f)
+			{
+				const RenderStateStats& state = renderState.getLastFrameStats();
+				char title[256];
+				snprintf(title, sizeof(title), "%s - CPU %.2f ms, GPU %.2f ms, %d of %d culled (%d occluded), %d binds skipped", WINDOW_TITLE,
+					last->samples[0].cpuTime, last->samples[0].gpuTime, culledInstances, (int)instances.size(), occludedInstances, state.avoided);
+				glfwSetWindowTitle(window, title);
+				lastTitleUpdate = lastFrame;
+			}
+		}
+		else if (profilerOverlay && !options.headless)
+		{
+			profilerOverlay.reset();
+			glfwSetWindowTitle(window, WINDOW_TITLE);
+		}
+
+		profiler.begin(presentScope);
+		if (options.headless && frameCapture)
+		{
+			// queue the readback, the pixels are collected a few frames later
+			frameCapture->capture(frameIndex);
+		}
+		else
+		{
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		profiler.end();
+		profiler.endFrame();
+
+		if (options.benchmark)
+		{
+			// frame time is start to start, so work the driver queues up is still counted once it throttles us
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (frameIndex >= BENCHMARK_WARMUP_FRAMES)
+				benchmarkRun.addFrame(std::chrono::duration<double, std::milli>(now - lastFrameStart).count(), drawCalls, triangles);
+			lastFrameStart = now;
+
+			const ProfileFrame* gpuFrame = profiler.getLastResolvedFrame();
+			if (gpuFrame && gpuFrame->index > lastGpuFrame)
+			{
+				benchmarkRun.addGpuTime(gpuFrame->samples[0].gpuTime);
+				lastGpuFrame = gpuFrame->index;
+			}
+		}
+		const RenderStateStats& frameState = renderState.getStats();
+		stateChanges += frameState.programChanges + frameState.textureChanges + frameState.vertexArrayChanges;
+		stateChangesAvoided += frameState.avoided;
+		frameIndex++;
 	}
 
+	if (options.recordPath)
+		inputRecording.save(options.recordPath);
+
+	int exitCode = 0;
+	if (options.benchmark)
+	{
+		// the last few frames are still in flight
+		profiler.flush();
+		for (const ProfileFrame* gpuFrame : profiler.getResolvedFrames())
+		{
+			if (gpuFrame->index > lastGpuFrame)
+				benchmarkRun.addGpuTime(gpuFrame->samples[0].gpuTime);
+		}
+
+		std::string variant = scenePath;
+		variant = variant.substr(variant.find_last_of("/\\") + 1);
+		variant = variant.substr(0, variant.find('.')) + "_x" + std::to_string(options.scale);
+		BenchmarkMetrics metrics = benchmarkRun.getMetrics();
+		std::cout << "Benchmark " << variant << ", " << benchmarkRun.getFrameCount() << " frames at "
+			<< options.width << "x" << options.height << ":" << std::endl;
+
+		// a baseline that was asked for but cannot be read fails the run, a gate that compares
+		// against nothing would always pass
+		BenchmarkResults baseline;
+		bool baselineMissing = options.baselinePath && !loadBenchmarkResults(options.baselinePath, baseline);
+		bool passed = compareBenchmarkResults(variant, metrics, options.baselinePath ? &baseline : NULL, options.threshold);
+		saveBenchmarkResults(options.resultsPath, variant, metrics);
+		if (baselineMissing)
+		{
+			std::cout << "Benchmark FAILED: baseline " << options.baselinePath << " not found" << std::endl;
+			exitCode = 1;
+		}
+		else if (!passed)
+		{
+			std::cout << "Benchmark FAILED against " << options.baselinePath << " (threshold " << options.threshold * 100.0f << "%)" << std::endl;
+			exitCode = 1;
+		}
+	}
+
+	if (options.profilePath)
+	{
+		profiler.flush();
+		profiler.printSummary();
+		if (frameIndex > 0)
+			std::cout << "State changes per frame: " << (double)stateChanges / frameIndex << " made, "
+				<< (double)stateChangesAvoided / frameIndex << " skipped by the state cache" << std::endl;
+		if (visibilityFrames > 0)
+			std::cout << "Visibility stage: " << visibilityTime / visibilityFrames << " ms per run, " << visibilityFrames << " of " << frameIndex << " frames" << std::endl;
+		std::cout << "Shadow views rendered: " << shadows.getRenderedViews() << " over " << frameIndex << " frames" << std::endl;
+		profiler.exportChromeTrace(options.profilePath);
+	}
+	profilerOverlay.reset();
+	hiZ.reset();
+
+	if (frameCapture)
+	{
+		frameCapture->finish();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+		std::cout << "Rendered " << frameIndex << " frames (" << options.width << "x" << options.height << ") in "
+			<< seconds << " s, " << frameIndex / seconds << " frames/s";
+		if (!options.outputDirectory.empty())
+			std::cout << ", wrote " << frameCapture->getFramesWritten() << " PNGs to " << options.outputDirectory;
+		std::cout << std::endl;
+		frameCapture.reset();
+	}
+	renderTarget.reset();
+
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &tableVAO);
-	glDeleteVertexArrays(1, &lightCubeVAO);
-	glDeleteBuffers(1, &tableVBO);
+	meshes.clear();
+	materials.reset();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
-	glfwTerminate();
-	return 0;
+	if (window)
+		glfwTerminate();
+	return exitCode;
+}
+
+// Command line: [scene file] [--headless] [--frames N] [--size WxH] [--camera-path file]
+//               [--output folder | --no-output] [--profile trace.json] [--scale N]
+//               [--record input.txt | --replay input.txt] [--vertex-format float | packed]
+//               [--depth-prepass] [--occlusion-culling]
+//               [--benchmark [--baseline results.txt] [--results results.txt] [--threshold 0.1]]
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless")
+			options.headless = true;
+		else if (arg == "--frames" && hasValue)
+			options.frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--size" && hasValue && sscanf(argv[++i], "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0)
+			continue;
+		else if (arg == "--camera-path" && hasValue)
+			options.cameraPath = argv[++i];
+		else if (arg == "--output" && hasValue)
+			options.outputDirectory = argv[++i];
+		else if (arg == "--no-output")
+			options.outputDirectory.clear();
+		else if (arg == "--profile" && hasValue)
+			options.profilePath = argv[++i];
+		else if (arg == "--scale" && hasValue)
+			options.scale = std::max(1, atoi(argv[++i]));
+		else if (arg == "--record" && hasValue)
+			options.recordPath = argv[++i];
+		else if (arg == "--replay" && hasValue)
+			options.replayPath = argv[++i];
+		else if (arg == "--benchmark")
+			options.benchmark = options.headless = true;
+		else if (arg == "--baseline" && hasValue)
+			options.baselinePath = argv[++i];
+		else if (arg == "--results" && hasValue)
+			options.resultsPath = argv[++i];
+		else if (arg == "--threshold" && hasValue)
+			options.threshold = (float)atof(argv[++i]);
+		else if (arg == "--vertex-format" && hasValue && (std::string(argv[i + 1]) == "float" || std::string(argv[i + 1]) == "packed"))
+			options.vertexFormat = std::string(argv[++i]) == "float" ? VERTEX_FORMAT_FLOAT : VERTEX_FORMAT_PACKED;
+		else if (arg == "--depth-prepass")
+			options.depthPrepass = true;
+		else if (arg == "--occlusion-culling")
+			options.occlusionCulling = true;
+		else if (arg.compare(0, 2, "--") != 0)
+			options.scenePath = argv[i];
+		else
+		{
+			std::cout << "Unknown or incomplete option " << arg << std::endl;
+			std::cout << "Usage: " << argv[0] << " [scene file] [--headless] [--frames N] [--size WxH] [--camera-path file] [--output folder | --no-output]" << std::endl;
+			std::cout << "       [--profile trace.json] [--scale N] [--record input.txt | --replay input.txt] [--vertex-format float | packed]" << std::endl;
+			std::cout << "       [--depth-prepass] [--occlusion-culling]" << std::endl;
+			std::cout << "       [--benchmark [--baseline results.txt] [--results results.txt] [--threshold 0.1]]" << std::endl;
+			return false;
+		}
+	}
+	if (options.benchmark && !options.replayPath)
+		options.replayPath = DEFAULT_BENCHMARK_INPUT;
+	return true;
 }
 
 // Process keyboard input
-void processInput(GLFWwindow* window)
+// Returns the movement keys held as Camera_Movement bits, the same bits input recordings store
+unsigned int processInput(GLFWwindow* window)
 {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
+	// a replay owns the camera, only ESC still works
+	if (replayingInput)
+		return 0;
 
+	unsigned int keys = 0;
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
+		keys |= 1u << FORWARD;
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
+		keys |= 1u << BACKWARD;
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
+		keys |= 1u << LEFT;
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		keys |= 1u << RIGHT;
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-		camera.ProcessKeyboard(UP, deltaTime);
+		keys |= 1u << UP;
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-		camera.ProcessKeyboard(DOWN, deltaTime);
-	
+		keys |= 1u << DOWN;
+	InputRecording::applyKeys(camera, keys, deltaTime);
+	return keys;
 }
 
 // Key callback method for keystrokes that need to be handle once per press, not every frame, 'P' key in this case
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	// F1 shows and hides the profiler overlay
+	if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+		showProfiler = !showProfiler;
+
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
 		if (perspective)
 		{
@@ -444,12 +983,22 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	}
 }
 
+// Left click asks for a pick, it is done in the render loop where the scene is known
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !replayingInput)
+		pickRequested = true;
+}
+
 // Process window size changes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
 	glViewport(0, 0, width, height);
+	// a minimized window reports 0, keep the last size for the levels of detail
+	if (height > 0)
+		framebufferHeight = height;
 }
 
 // Process mouse movement
@@ -468,7 +1017,11 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	lastX = xpos;
 	lastY = ypos;
 
+	if (replayingInput)
+		return;
 	camera.ProcessMouseMovement(xoffset, yoffset);
+	frameMouseX += xoffset;
+	frameMouseY += yoffset;
 }
 
 // Process mouse wheel scroll - speeds up and slows down camera speed
@@ -476,111 +1029,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.ProcessMouseScroll(yoffset);
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		flipImageVertically(data, width, height, nrComponents);
-
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
-
-// Create vbo and vao for cube shaped objects 
-void createCube(unsigned int& vbo, unsigned int& vao, float posX, float posY, float posZ) {
-	float negX = -1.0 * posX;
-	float negZ = -1.0 * posZ;
-
-	// Vertex Data
-	float verts[] = {
-		// positions          // normals           // texture coords
-		negX,  0.0f,  negZ,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-		posX,  0.0f,  negZ,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-		posX,  posY,  negZ,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-		posX,  posY,  negZ,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-		negX,  posY,  negZ,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-		negX,  0.0f,  negZ,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-
-		negX,  0.0f,  posZ,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-		posX,  0.0f,  posZ,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-		posX,  posY,  posZ,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-		posX,  posY,  posZ,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-		negX,  posY,  posZ,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-		negX,  0.0f,  posZ,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-
-		negX,  posY,  posZ, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-		negX,  posY,  negZ, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-		negX,  0.0f,  negZ, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-		negX,  0.0f,  negZ, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-		negX,  0.0f,  posZ, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-		negX,  posY,  posZ, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-		posX,  posY,  posZ,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-		posX,  posY,  negZ,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-		posX,  0.0f,  negZ,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-		posX,  0.0f,  negZ,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-		posX,  0.0f,  posZ,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-		posX,  posY,  posZ,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-		negX,  0.0f,  negZ,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-		posX,  0.0f,  negZ,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-		posX,  0.0f,  posZ,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-		posX,  0.0f,  posZ,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-		negX,  0.0f,  posZ,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-		negX,  0.0f,  negZ,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-
-		negX,  posY,  negZ,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-		posX,  posY,  negZ,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-		posX,  posY,  posZ,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-		posX,  posY,  posZ,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-		negX,  posY,  posZ,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-		negX,  posY,  negZ,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f
-	};
-
-	glGenVertexArrays(1, &vao);
-	glGenBuffers(1, &vbo);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-	glBindVertexArray(vao);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-}
\ No newline at end of file
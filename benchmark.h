@@ -0,0 +1,344 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "camera.h"
+
+// Recordings are stored and replayed at this fixed time step, so a replay moves the camera
+// exactly the same way no matter how fast the machine renders
+const float BENCHMARK_TIME_STEP = 1.0f / 60.0f;
+// frames rendered from the start position before measuring, lets textures and drivers settle
+const int BENCHMARK_WARMUP_FRAMES = 30;
+// default allowed slowdown against the baseline before a run fails
+const float BENCHMARK_DEFAULT_THRESHOLD = 0.10f;
+
+// Movement keys in Camera_Movement order, one bit each in InputFrame::keys
+const char INPUT_KEY_NAMES[] = "WSADEQ";
+const int INPUT_KEY_COUNT = 6;
+
+// Camera input during one time step: held movement keys and the mouse offset
+struct InputFrame
+{
+	unsigned int keys;
+	float mouseX;
+	float mouseY;
+};
+
+// Camera input recorded from the interactive controls and replayed through the same Camera
+// calls (ProcessKeyboard / ProcessMouseMovement), resampled to BENCHMARK_TIME_STEP.
+class InputRecording
+{
+public:
+	std::vector<InputFrame> frames;
+
+	// Add the input of one rendered frame. Slow frames become several steps, fast frames are
+	// merged until a whole step has passed; mouse movement is spread over the steps.
+	void record(float deltaTime, unsigned int keys, float mouseX, float mouseY)
+	{
+		pendingTime += deltaTime;
+		pendingMouseX += mouseX;
+		pendingMouseY += mouseY;
+		int steps = (int)(pendingTime / BENCHMARK_TIME_STEP);
+		for (int i = 0; i < steps; i++)
+		{
+			InputFrame frame = { keys, pendingMouseX / steps, pendingMouseY / steps };
+			frames.push_back(frame);
+		}
+		if (steps > 0)
+		{
+			pendingTime -= steps * BENCHMARK_TIME_STEP;
+			pendingMouseX = pendingMouseY = 0.0f;
+		}
+	}
+
+	// Move the camera by one recorded step
+	void apply(size_t frame, Camera& camera) const
+	{
+		applyKeys(camera, frames[frame].keys, BENCHMARK_TIME_STEP);
+		if (frames[frame].mouseX != 0.0f || frames[frame].mouseY != 0.0f)
+			camera.ProcessMouseMovement(frames[frame].mouseX, frames[frame].mouseY);
+	}
+
+	// Shared with the live controls so recording and replay move the camera identically
+	static void applyKeys(Camera& camera, unsigned int keys, float deltaTime)
+	{
+		for (int i = 0; i < INPUT_KEY_COUNT; i++)
+		{
+			if (keys & (1u << i))
+				camera.ProcessKeyboard((Camera_Movement)i, deltaTime);
+		}
+	}
+
+	// Format, '#' starts a comment:
+	//   step <seconds>                 must match BENCHMARK_TIME_STEP
+	//   input <keys|-> <mouse x> <mouse y>   keys held, e.g. WA, one line per step
+	bool load(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "Input recording failed to load at path: " << path << std::endl;
+			return false;
+		}
+
+		frames.clear();
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+
+			std::istringstream in(line);
+			std::string keyword;
+			if (!(in >> keyword))
+				continue;
+
+			bool ok = true;
+			if (keyword == "step")
+			{
+				float step = 0.0f;
+				ok = (bool)(in >> step) && std::fabs(step - BENCHMARK_TIME_STEP) < 1e-5f;
+			}
+			else if (keyword == "input")
+			{
+				std::string keys;
+				InputFrame frame = { 0, 0.0f, 0.0f };
+				ok = (bool)(in >> keys >> frame.mouseX >> frame.mouseY);
+				for (char key : keys)
+				{
+					const char* found = std::strchr(INPUT_KEY_NAMES, key);
+					if (found && key != '\0')
+						frame.keys |= 1u << (found - INPUT_KEY_NAMES);
+					else if (key != '-')
+						ok = false;
+				}
+				frames.push_back(frame);
+			}
+			else
+			{
+				ok = false;
+			}
+
+			if (!ok)
+			{
+				std::cout << "Input recording " << path << " line " << lineNumber << ": could not parse \"" << line << "\"" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool save(const char* path) const
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "Failed to write input recording " << path << std::endl;
+			return false;
+		}
+		file << "# camera input, one line per fixed time step: input <keys|-> <mouse x> <mouse y>" << std::endl;
+		file << "step " << BENCHMARK_TIME_STEP << std::endl;
+		for (const InputFrame& frame : frames)
+		{
+			std::string keys;
+			for (int i = 0; i < INPUT_KEY_COUNT; i++)
+			{
+				if (frame.keys & (1u << i))
+					keys += INPUT_KEY_NAMES[i];
+			}
+			file << "input " << (keys.empty() ? "-" : keys) << " " << frame.mouseX << " " << frame.mouseY << std::endl;
+		}
+		std::cout << "Wrote " << frames.size() << " input steps to " << path << std::endl;
+		return true;
+	}
+
+private:
+	float pendingTime = 0.0f;
+	float pendingMouseX = 0.0f;
+	float pendingMouseY = 0.0f;
+};
+
+// Nearest rank percentile, p in 0..100
+inline double getPercentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+	return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Peak resident memory of the process in megabytes
+inline double getPeakMemoryMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	return 0.0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0);	// bytes
+#else
+	return usage.ru_maxrss / 1024.0;	// kilobytes
+#endif
+#endif
+}
+
+// Metrics of one benchmark run, every metric is "lower is better"
+typedef std::vector<std::pair<std::string, double>> BenchmarkMetrics;
+
+// Frame statistics collected while a benchmark replays its recording
+class BenchmarkRun
+{
+public:
+	void addFrame(double cpuMs, int drawCalls, long long triangles)
+	{
+		cpuTimes.push_back(cpuMs);
+		totalDrawCalls += drawCalls;
+		totalTriangles += triangles;
+	}
+
+	void addGpuTime(double gpuMs)
+	{
+		gpuTimes.push_back(gpuMs);
+	}
+
+	BenchmarkMetrics getMetrics() const
+	{
+		BenchmarkMetrics metrics;
+		size_t frames = std::max((size_t)1, cpuTimes.size());
+		metrics.push_back(std::make_pair("frame_p50_ms", getPercentile(cpuTimes, 50.0)));
+		metrics.push_back(std::make_pair("frame_p95_ms", getPercentile(cpuTimes, 95.0)));
+		metrics.push_back(std::make_pair("frame_p99_ms", getPercentile(cpuTimes, 99.0)));
+		metrics.push_back(std::make_pair("gpu_p50_ms", getPercentile(gpuTimes, 50.0)));
+		metrics.push_back(std::make_pair("gpu_p95_ms", getPercentile(gpuTimes, 95.0)));
+		metrics.push_back(std::make_pair("draw_calls", (double)totalDrawCalls / frames));
+		metrics.push_back(std::make_pair("triangles", (double)totalTriangles / frames));
+		metrics.push_back(std::make_pair("peak_memory_mb", getPeakMemoryMB()));
+		return metrics;
+	}
+
+	int getFrameCount() const { return (int)cpuTimes.size(); }
+
+private:
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+	long long totalDrawCalls = 0;
+	long long totalTriangles = 0;
+};
+
+// Results file: one "<variant> <metric> <value>" line per metric, every variant in one file
+typedef std::map<std::string, std::map<std::string, double>> BenchmarkResults;
+
+inline bool loadBenchmarkResults(const char* path, BenchmarkResults& results)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		return false;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream in(line);
+		std::string variant, metric;
+		double value;
+		if (in >> variant >> metric >> value)
+			results[variant][metric] = value;
+	}
+	return true;
+}
+
+// Replace this variant's entries in the results file, other variants are kept
+inline bool saveBenchmarkResults(const char* path, const std::string& variant, const BenchmarkMetrics& metrics)
+{
+	BenchmarkResults results;
+	loadBenchmarkResults(path, results);
+	results[variant].clear();
+	for (const std::pair<std::string, double>& metric : metrics)
+		results[variant][metric.first] = metric.second;
+
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "Failed to write benchmark results " << path << std::endl;
+		return false;
+	}
+	file << "# <variant> <metric> <value>, lower is better" << std::endl;
+	for (const auto& entry : results)
+	{
+		for (const auto& metric : entry.second)
+			file << entry.first << " " << metric.first << " " << metric.second << std::endl;
+	}
+	return true;
+}
+
+// Print every metric next to its baseline. Returns false if one is more than threshold
+// (0.1 = 10%) worse than the baseline, or if the baseline has no entry for variant at all;
+// single metrics missing from the baseline are not checked. Without a baseline (NULL) the
+// metrics are only printed.
+inline bool compareBenchmarkResults(const std::string& variant, const BenchmarkMetrics& metrics, const BenchmarkResults* baseline, float threshold)
+{
+	BenchmarkResults::const_iterator base;
+	bool passed = true;
+	if (baseline)
+	{
+		base = baseline->find(variant);
+		if (base == baseline->end())
+		{
+			std::cout << "  no baseline for " << variant << ", nothing was compared" << std::endl;
+			passed = false;
+		}
+	}
+	for (const std::pair<std::string, double>& metric : metrics)
+	{
+		char line[160];
+		if (!baseline || base == baseline->end() || base->second.find(metric.first) == base->second.end())
+		{
+			snprintf(line, sizeof(line), "  %-16s %12.3f", metric.first.c_str(), metric.second);
+			std::cout << line << std::endl;
+			continue;
+		}
+
+		double reference = base->second.find(metric.first)->second;
+		double change = reference > 0.0 ? metric.second / reference - 1.0 : 0.0;
+		bool regressed = change > threshold;
+		snprintf(line, sizeof(line), "  %-16s %12.3f  baseline %12.3f  %+6.1f%%%s", metric.first.c_str(), metric.second,
+			reference, change * 100.0, regressed ? "  REGRESSION" : "");
+		std::cout << line << std::endl;
+		passed = passed && !regressed;
+	}
+	return passed;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Axis aligned bounding box
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+	glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+// Box around the transformed corners of box (Arvo's method, no need to transform all eight)
+inline BoundingBox transformBoundingBox(const BoundingBox& box, const glm::mat4& matrix)
+{
+	BoundingBox result;
+	result.min = result.max = glm::vec3(matrix[3]);
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			float a = matrix[column][row] * box.min[column];
+			float b = matrix[column][row] * box.max[column];
+			result.min[row] += std::min(a, b);
+			result.max[row] += std::max(a, b);
+		}
+	}
+	return result;
+}
+
+// Sphere around the transformed sphere, non uniform scale grows the radius by the largest axis
+inline BoundingSphere transformBoundingSphere(const BoundingSphere& sphere, const glm::mat4& matrix)
+{
+	BoundingSphere result;
+	result.center = glm::vec3(matrix * glm::vec4(sphere.center, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+	result.radius = sphere.radius * scale;
+	return result;
+}
+
+enum Frustum_Test {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE
+};
+
+// The six clip planes of a view volume, normals point inwards: a point p is inside a plane when
+// dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Planes straight from a projection * view matrix (Gribb and Hartmann), works for the
+	// perspective and the orthographic projection alike
+	void extract(const glm::mat4& viewProjection)
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		planes[0] = rows[3] + rows[0];	// left
+		planes[1] = rows[3] - rows[0];	// right
+		planes[2] = rows[3] + rows[1];	// bottom
+		planes[3] = rows[3] - rows[1];	// top
+		planes[4] = rows[3] + rows[2];	// near
+		planes[5] = rows[3] - rows[2];	// far
+		for (int i = 0; i < 6; i++)
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+
+	Frustum_Test test(const BoundingSphere& sphere) const
+	{
+		Frustum_Test result = FRUSTUM_INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			float distance = glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w;
+			if (distance < -sphere.radius)
+				return FRUSTUM_OUTSIDE;
+			if (distance < sphere.radius)
+				result = FRUSTUM_INTERSECTS;
+		}
+		return result;
+	}
+
+	// Conservative: boxes near a frustum corner can pass although they are outside
+	Frustum_Test test(const BoundingBox& box) const
+	{
+		glm::vec3 center = box.getCenter();
+		glm::vec3 extents = box.getExtents();
+		Frustum_Test result = FRUSTUM_INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal = glm::vec3(planes[i]);
+			// projected half size of the box onto the plane normal
+			float radius = extents.x * std::fabs(normal.x) + extents.y * std::fabs(normal.y) + extents.z * std::fabs(normal.z);
+			float distance = glm::dot(normal, center) + planes[i].w;
+			if (distance < -radius)
+				return FRUSTUM_OUTSIDE;
+			if (distance < radius)
+				result = FRUSTUM_INTERSECTS;
+		}
+		return result;
+	}
+};
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "bounds.h"
+
+// binned SAH build: candidate split planes per axis, and the most items kept in one leaf
+const int BVH_BINS = 12;
+const int BVH_MAX_LEAF_ITEMS = 4;
+// refit() only moves boxes, the tree shape stays. Once the refitted tree is this much more
+// expensive than right after the build, refit() reports it so the owner can rebuild.
+const float BVH_REBUILD_RATIO = 1.5f;
+
+struct BVHNode
+{
+	BoundingBox box;
+	int right;	// second child, the first child directly follows its parent. -1 for a leaf
+	int first;	// items of the whole subtree are items[first, first + count)
+	int count;
+};
+
+// Bounding volume hierarchy over a set of boxes, items are referred to by their index in the
+// array passed to build(). Nodes are stored depth first, so every subtree covers one contiguous
+// range of items and a subtree found to be entirely inside a query is taken without any tests.
+class BVH
+{
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<int> items;
+
+	// Surface area heuristic build, boxes with min > max (empty) are left out
+	void build(const std::vector<BoundingBox>& boxes)
+	{
+		nodes.clear();
+		items.clear();
+		parents.clear();
+		itemLeaves.assign(boxes.size(), -1);
+		centroids.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			if (isEmpty(boxes[i]))
+				continue;
+			items.push_back((int)i);
+			centroids[i] = boxes[i].getCenter();
+		}
+		if (items.empty())
+			return;
+
+		nodes.reserve(items.size() * 2);
+		parents.reserve(items.size() * 2);
+		buildNode(boxes, 0, (int)items.size(), -1);
+		weightedArea = getWeightedArea();
+		builtCost = getCost();
+	}
+
+	// Update the node boxes after the items in changed got new boxes, without changing the
+	// tree: the leaves holding them and their ancestors, going up only while a box still
+	// changes. Returns false when the tree has become much worse than a fresh build, or an item
+	// appeared or disappeared (its box became or stopped being empty), and should be rebuilt.
+	bool refit(const std::vector<BoundingBox>& boxes, const std::vector<int>& changed)
+	{
+		for (int item : changed)
+		{
+			int index = itemLeaves[item];
+			if (index < 0 || isEmpty(boxes[item]))
+			{
+				if (index < 0 && isEmpty(boxes[item]))
+					continue;
+				return false;
+			}
+
+			// the leaf from its items, then every parent from its two children
+			const BVHNode& leaf = nodes[index];
+			BoundingBox box = boxes[items[leaf.first]];
+			for (int j = leaf.first + 1; j < leaf.first + leaf.count; j++)
+				box = mergeBoxes(box, boxes[items[j]]);
+			while (index >= 0 && setNodeBox(index, box))
+			{
+				index = parents[index];
+				if (index >= 0)
+					box = mergeBoxes(nodes[index + 1].box, nodes[nodes[index].right].box);
+			}
+		}
+		return nodes.empty() || getCost() <= builtCost * BVH_REBUILD_RATIO;
+	}
+
+	// Call inside(item) for every item whose subtree is entirely inside the frustum and
+	// intersects(item) for the items of leaves that straddle a plane, those still need their
+	// own test. Whole subtrees outside the frustum are skipped.
+	template <typename Inside, typename Intersects>
+	void queryFrustum(const Frustum& frustum, Inside inside, Intersects intersects) const
+	{
+		if (nodes.empty())
+			return;
+		std::vector<int> stack(1, 0);
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+			const BVHNode& node = nodes[index];
+			Frustum_Test result = frustum.test(node.box);
+			if (result == FRUSTUM_OUTSIDE)
+				continue;
+			if (result == FRUSTUM_INSIDE)
+			{
+				for (int i = node.first; i < node.first + node.count; i++)
+					inside(items[i]);
+			}
+			else if (node.right < 0)
+			{
+				for (int i = node.first; i < node.first + node.count; i++)
+					intersects(items[i]);
+			}
+			else
+			{
+				stack.push_back(node.right);
+				stack.push_back(index + 1);
+			}
+		}
+	}
+
+	// Closest item hit by the ray within maxDistance, -1 if none. hit(item, origin, direction)
+	// returns the exact distance to the item or a negative value for a miss, so callers can
+	// test the real shape inside the box. Near children are visited first and anything
+	// further than the closest hit so far is skipped.
+	template <typename Hit>
+	int raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit hit, float* distance = NULL) const
+	{
+		int closest = -1;
+		float closestDistance = maxDistance;
+		if (nodes.empty())
+			return closest;
+
+		glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		std::vector<int> stack(1, 0);
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+			const BVHNode& node = nodes[index];
+			float entry;
+			if (!intersectRay(node.box, origin, inverse, closestDistance, entry))
+				continue;
+
+			if (node.right < 0)
+			{
+				for (int i = node.first; i < node.first + node.count; i++)
+				{
+					float t = hit(items[i], origin, direction);
+					if (t >= 0.0f && t < closestDistance)
+					{
+						closestDistance = t;
+						closest = items[i];
+					}
+				}
+				continue;
+			}
+
+			// push the far child first so the near one is popped next
+			float leftEntry, rightEntry;
+			bool left = intersectRay(nodes[index + 1].box, origin, inverse, closestDistance, leftEntry);
+			bool right = intersectRay(nodes[node.right].box, origin, inverse, closestDistance, rightEntry);
+			if (left && right)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+				stack.push_back(leftFirst ? node.right : index + 1);
+				stack.push_back(leftFirst ? index + 1 : node.right);
+			}
+			else if (left)
+				stack.push_back(index + 1);
+			else if (right)
+				stack.push_back(node.right);
+		}
+		if (distance && closest >= 0)
+			*distance = closestDistance;
+		return closest;
+	}
+
+	// Slab test, entry is where the ray enters the box (0 when it starts inside)
+	static bool intersectRay(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry)
+	{
+		float tmin = 0.0f;
+		float tmax = maxDistance;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t0 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			// NaN from 0 * inf (ray in the slab plane) must not reject the box
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax)
+				return false;
+		}
+		entry = tmin;
+		return true;
+	}
+
+	// SAH cost of the tree relative to its root: sum of node areas over the root area. The sum
+	// is kept up to date by refit(), so this does not walk the tree.
+	float getCost() const
+	{
+		if (nodes.empty())
+			return 0.0f;
+		return weightedArea / std::max(getSurfaceArea(nodes[0].box), FLT_MIN);
+	}
+
+	int getDepth() const
+	{
+		return nodes.empty() ? 0 : getDepth(0);
+	}
+
+	static BoundingBox mergeBoxes(const BoundingBox& a, const BoundingBox& b)
+	{
+		BoundingBox result;
+		result.min = glm::min(a.min, b.min);
+		result.max = glm::max(a.max, b.max);
+		return result;
+	}
+
+	static float getSurfaceArea(const BoundingBox& box)
+	{
+		glm::vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	static bool isEmpty(const BoundingBox& box)
+	{
+		return box.min.x > box.max.x;
+	}
+
+private:
+	std::vector<glm::vec3> centroids;
+	std::vector<int> parents;		// per node, -1 for the root
+	std::vector<int> itemLeaves;	// per box passed to build(), the leaf holding it or -1
+	float weightedArea = 0.0f;		// node areas weighted like getCost(), not yet divided by the root's
+	float builtCost = 0.0f;
+
+	// sum of the node areas, every leaf counted once per item
+	float getWeightedArea() const
+	{
+		float area = 0.0f;
+		for (const BVHNode& node : nodes)
+			area += getSurfaceArea(node.box) * (node.right < 0 ? node.count : 1);
+		return area;
+	}
+
+	// Returns false if the node already had this box
+	bool setNodeBox(int index, const BoundingBox& box)
+	{
+		BVHNode& node = nodes[index];
+		if (node.box.min == box.min && node.box.max == box.max)
+			return false;
+		float weight = node.right < 0 ? (float)node.count : 1.0f;
+		weightedArea += (getSurfaceArea(box) - getSurfaceArea(node.box)) * weight;
+		node.box = box;
+		return true;
+	}
+
+	int buildNode(const std::vector<BoundingBox>& boxes, int first, int count, int parent)
+	{
+		int index = (int)nodes.size();
+		nodes.push_back(BVHNode());
+		parents.push_back(parent);
+		BoundingBox box = boxes[items[first]];
+		BoundingBox centroidBox;
+		centroidBox.min = centroidBox.max = centroids[items[first]];
+		for (int i = first + 1; i < first + count; i++)
+		{
+			box = mergeBoxes(box, boxes[items[i]]);
+			centroidBox.min = glm::min(centroidBox.min, centroids[items[i]]);
+			centroidBox.max = glm::max(centroidBox.max, centroids[items[i]]);
+		}
+		nodes[index].box = box;
+		nodes[index].right = -1;
+		nodes[index].first = first;
+		nodes[index].count = count;
+		if (count <= BVH_MAX_LEAF_ITEMS)
+		{
+			for (int i = first; i < first + count; i++)
+				itemLeaves[items[i]] = index;
+			return index;
+		}
+
+		// bin the centroids along every axis and keep the cheapest split
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidBox.max[axis] - centroidBox.min[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			BoundingBox binBoxes[BVH_BINS];
+			int binCounts[BVH_BINS] = {};
+			for (int i = first; i < first + count; i++)
+			{
+				int bin = getBin(centroids[items[i]][axis], centroidBox.min[axis], extent);
+				binBoxes[bin] = binCounts[bin] ? mergeBoxes(binBoxes[bin], boxes[items[i]]) : boxes[items[i]];
+				binCounts[bin]++;
+			}
+
+			// areas of everything right of each plane, then sweep from the left
+			float rightAreas[BVH_BINS];
+			int rightCounts[BVH_BINS];
+			BoundingBox accumulated;
+			int accumulatedCount = 0;
+			for (int bin = BVH_BINS - 1; bin > 0; bin--)
+			{
+				if (binCounts[bin])
+					accumulated = accumulatedCount ? mergeBoxes(accumulated, binBoxes[bin]) : binBoxes[bin];
+				accumulatedCount += binCounts[bin];
+				rightAreas[bin] = accumulatedCount ? getSurfaceArea(accumulated) : 0.0f;
+				rightCounts[bin] = accumulatedCount;
+			}
+			accumulatedCount = 0;
+			for (int split = 1; split < BVH_BINS; split++)
+			{
+				int bin = split - 1;
+				if (binCounts[bin])
+					accumulated = accumulatedCount ? mergeBoxes(accumulated, binBoxes[bin]) : binBoxes[bin];
+				accumulatedCount += binCounts[bin];
+				if (accumulatedCount == 0 || rightCounts[split] == 0)
+					continue;
+				float cost = getSurfaceArea(accumulated) * accumulatedCount + rightAreas[split] * rightCounts[split];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		int middle;
+		if (bestAxis < 0)
+		{
+			// every centroid in one spot, split the list in half
+			middle = first + count / 2;
+		}
+		else
+		{
+			float minimum = centroidBox.min[bestAxis];
+			float extent = centroidBox.max[bestAxis] - minimum;
+			middle = (int)(std::partition(items.begin() + first, items.begin() + first + count, [&](int item) {
+				return getBin(centroids[item][bestAxis], minimum, extent) < bestSplit;
+			}) - items.begin());
+		}
+
+		buildNode(boxes, first, middle - first, index);
+		int right = buildNode(boxes, middle, first + count - middle, index);
+		nodes[index].right = right;
+		return index;
+	}
+
+	static int getBin(float value, float minimum, float extent)
+	{
+		int bin = (int)((value - minimum) / extent * BVH_BINS);
+		return std::min(std::max(bin, 0), BVH_BINS - 1);
+	}
+
+	int getDepth(int index) const
+	{
+		if (nodes[index].right < 0)
+			return 1;
+		return 1 + std::max(getDepth(index + 1), getDepth(nodes[index].right));
+	}
+};
+
+#endif
@@ -118,6 +118,16 @@ public:
 		}
 	}
 
+	// Points the camera at target, used by scripted camera paths instead of mouse input
+	void LookAt(glm::vec3 target)
+	{
+		glm::vec3 direction = glm::normalize(target - Position);
+		Yaw = glm::degrees(atan2(direction.z, direction.x));
+		// same limit as the mouse, straight up or down has no usable right vector
+		Pitch = glm::clamp(glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f))), -89.0f, 89.0f);
+		updateCameraVectors();
+	}
+
 private:
 	// calculates the front vector from the Camera's (updated) Euler Angles
 	void updateCameraVectors()
@@ -0,0 +1,148 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+
+// One point on a scripted camera path: where the camera is and what it looks at
+struct CameraKeyframe
+{
+	float time;
+	glm::vec3 position;
+	glm::vec3 target;
+};
+
+// Scripted camera movement for headless rendering. Positions follow a Catmull-Rom spline through
+// the keyframes so the camera moves smoothly, the look-at target is interpolated linearly.
+class CameraPath
+{
+public:
+	std::vector<CameraKeyframe> keyframes;
+
+	// Load a path description. Format, one keyframe per line in time order, '#' starts a comment:
+	//   key <time> <px py pz> <tx ty tz>
+	bool load(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "Camera path failed to load at path: " << path << std::endl;
+			return false;
+		}
+
+		keyframes.clear();
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+
+			std::istringstream in(line);
+			std::string keyword;
+			if (!(in >> keyword))
+				continue;
+
+			CameraKeyframe key;
+			if (keyword != "key" || !(in >> key.time >> key.position.x >> key.position.y >> key.position.z
+				>> key.target.x >> key.target.y >> key.target.z))
+			{
+				std::cout << path << ":" << lineNumber << ": expected key <time> <px py pz> <tx ty tz>" << std::endl;
+				return false;
+			}
+			if (!keyframes.empty() && key.time <= keyframes.back().time)
+			{
+				std::cout << path << ":" << lineNumber << ": keyframe times must increase" << std::endl;
+				return false;
+			}
+			keyframes.push_back(key);
+		}
+
+		if (keyframes.empty())
+		{
+			std::cout << "Camera path " << path << " has no keyframes" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Circle around center once in duration seconds, the default when no path file is given
+	void makeOrbit(glm::vec3 center, float radius, float height, float duration, int steps = 16)
+	{
+		keyframes.clear();
+		for (int i = 0; i <= steps; i++)
+		{
+			float angle = glm::two_pi<float>() * i / steps;
+			CameraKeyframe key;
+			key.time = duration * i / steps;
+			key.position = center + glm::vec3(radius * cos(angle), height, radius * sin(angle));
+			key.target = center;
+			keyframes.push_back(key);
+		}
+	}
+
+	float getDuration() const
+	{
+		return keyframes.empty() ? 0.0f : keyframes.back().time;
+	}
+
+	// Position and target at time t, clamped to the ends of the path
+	void sample(float t, glm::vec3& position, glm::vec3& target) const
+	{
+		if (keyframes.empty())
+			return;
+		if (keyframes.size() == 1 || t <= keyframes.front().time)
+		{
+			position = keyframes.front().position;
+			target = keyframes.front().target;
+			return;
+		}
+		if (t >= keyframes.back().time)
+		{
+			position = keyframes.back().position;
+			target = keyframes.back().target;
+			return;
+		}
+
+		size_t i = 1;
+		while (keyframes[i].time < t)
+			i++;
+		const CameraKeyframe& a = keyframes[i - 1];
+		const CameraKeyframe& b = keyframes[i];
+		// the end points are repeated so the spline still passes through the first and last key
+		const glm::vec3& before = keyframes[i >= 2 ? i - 2 : i - 1].position;
+		const glm::vec3& after = keyframes[i + 1 < keyframes.size() ? i + 1 : i].position;
+
+		float s = (t - a.time) / (b.time - a.time);
+		float s2 = s * s;
+		float s3 = s2 * s;
+		position = 0.5f * ((2.0f * a.position) + (-before + b.position) * s
+			+ (2.0f * before - 5.0f * a.position + 4.0f * b.position - after) * s2
+			+ (-before + 3.0f * a.position - 3.0f * b.position + after) * s3);
+		target = glm::mix(a.target, b.target, s);
+	}
+
+	// Move the camera to where the path is at time t
+	void apply(float t, Camera& camera) const
+	{
+		glm::vec3 position, target;
+		sample(t, position, target);
+		camera.Position = position;
+		camera.LookAt(target);
+	}
+};
+
+#endif
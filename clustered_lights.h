@@ -0,0 +1,296 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "job_system.h"
+#include "lights.h"
+
+// Froxel grid over the view frustum: tiles across the screen and slices in depth, the slices
+// spaced exponentially so near clusters are not stretched. The shaders get the grid size as a
+// uniform.
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+// Texture units of the three light buffers, see ClusteredLights
+const int POINT_LIGHT_DATA_UNIT = 2;
+const int CLUSTER_RANGES_UNIT = 3;
+const int CLUSTER_INDICES_UNIT = 4;
+
+// Fewer lights than this are assigned on the calling thread, jobs would cost more
+const size_t CLUSTER_PARALLEL_MIN_LIGHTS = 32;
+
+// Clustered forward lighting: every frame the point lights are assigned on the CPU to the
+// clusters they touch, and the fragment shader only loops over the lights of its own cluster,
+// so a pixel's cost depends on how many lights reach it rather than on the total.
+// GL 3.3 has no storage buffers, so the shader reads three texture buffers:
+//   point light data, four RGBA32F texels per light (the PointLight layout)
+//   cluster ranges, RG32UI (first index, count) per cluster, x fastest, then y, then slice
+//   light indices, R32UI, the clusters' lists back to back
+// Slices are assigned in parallel on the job system, if given one, when there are enough lights.
+class ClusteredLights
+{
+public:
+	ClusteredLights(JobSystem* jobs = NULL) : jobs(jobs)
+	{
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		for (int i = 0; i < 3; i++)
+		{
+			// never empty, a texture buffer needs a data store
+			glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		GLint maxTexels = 65536;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		maxIndices = (size_t)maxTexels;
+		clusterLists.resize(CLUSTER_COUNT);
+	}
+
+	~ClusteredLights()
+	{
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+
+	void setPointLightCount(int count)
+	{
+		if ((size_t)count != lights.size())
+		{
+			lights.resize(count);
+			lightsDirty = true;
+		}
+	}
+
+	void setPointLight(int index, const PointLight& light)
+	{
+		if (std::memcmp(&lights[index], &light, sizeof(PointLight)) != 0)
+		{
+			lights[index] = light;
+			lightsDirty = true;
+		}
+	}
+
+	const PointLight& getPointLight(int index) const { return lights[index]; }
+	int getPointLightCount() const { return (int)lights.size(); }
+
+	// Reassign the lights to the clusters of this view and upload the lists, only when the
+	// camera or a light changed. projection has to be symmetric, glm::perspective or glm::ortho.
+	void update(const glm::mat4& view, const glm::mat4& projection)
+	{
+		if (!lightsDirty && view == lastView && projection == lastProjection)
+			return;
+		if (projection != lastProjection)
+			setProjection(projection);
+
+		if (lightsDirty)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+			glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(lights.size() * sizeof(PointLight), 16), lights.empty() ? NULL : lights.data(), GL_STREAM_DRAW);
+		}
+
+		// light spheres in view space, w is the radius
+		viewLights.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+			viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+
+		parallelFor(lights.size() >= CLUSTER_PARALLEL_MIN_LIGHTS ? jobs : NULL, 0, CLUSTER_SLICES, 1, [this](size_t first, size_t last) {
+			assignSlices((int)first, (int)last);
+		});
+
+		// compact the lists into one index buffer
+		indices.clear();
+		ranges.resize(CLUSTER_COUNT * 2);
+		bool truncated = false;
+		for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+		{
+			const std::vector<uint32_t>& list = clusterLists[cluster];
+			size_t count = std::min(list.size(), maxIndices - indices.size());
+			truncated = truncated || count < list.size();
+			ranges[cluster * 2] = (uint32_t)indices.size();
+			ranges[cluster * 2 + 1] = (uint32_t)count;
+			indices.insert(indices.end(), list.begin(), list.begin() + count);
+		}
+		if (truncated && !warnedTruncated)
+		{
+			std::cout << "Cluster light lists exceed the texture buffer size, some lights are dropped" << std::endl;
+			warnedTruncated = true;
+		}
+
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+		glBufferData(GL_TEXTURE_BUFFER, ranges.size() * sizeof(uint32_t), ranges.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size() * sizeof(uint32_t), 16), indices.empty() ? NULL : indices.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		lastView = view;
+		lightsDirty = false;
+	}
+
+	// Uniforms the fragment shader needs to find its cluster, set with the program bound
+	void setUniforms(GLuint program) const
+	{
+		glUniform1i(glGetUniformLocation(program, "pointLightData"), POINT_LIGHT_DATA_UNIT);
+		glUniform1i(glGetUniformLocation(program, "clusterRanges"), CLUSTER_RANGES_UNIT);
+		glUniform1i(glGetUniformLocation(program, "clusterIndices"), CLUSTER_INDICES_UNIT);
+		glUniform3i(glGetUniformLocation(program, "clusterGrid"), CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+		// slice = log(depth) * scale + bias
+		float scale = CLUSTER_SLICES / std::log(farPlane / nearPlane);
+		glUniform2f(glGetUniformLocation(program, "clusterDepthScaleBias"), scale, -std::log(nearPlane) * scale);
+	}
+
+	GLuint getLightTexture() const { return textures[0]; }
+	GLuint getRangeTexture() const { return textures[1]; }
+	GLuint getIndexTexture() const { return textures[2]; }
+	float getNearPlane() const { return nearPlane; }
+	float getFarPlane() const { return farPlane; }
+
+	// Lights assigned to clusters last update, summed over clusters
+	size_t getAssignedCount() const { return indices.size(); }
+
+private:
+	JobSystem* jobs;
+	GLuint buffers[3];
+	GLuint textures[3];
+	size_t maxIndices;
+
+	std::vector<PointLight> lights;
+	bool lightsDirty = true;
+	bool warnedTruncated = false;
+	glm::mat4 lastView = glm::mat4(0.0f);
+	glm::mat4 lastProjection = glm::mat4(0.0f);
+
+	float nearPlane = 0.1f, farPlane = 100.0f;
+	// view space half extent of the frustum per unit of depth, or in total for orthographic
+	float halfExtent[2] = { 1.0f, 1.0f };
+	bool orthographic = false;
+	float sliceDepths[CLUSTER_SLICES + 1];
+
+	std::vector<glm::vec4> viewLights;
+	std::vector<std::vector<uint32_t>> clusterLists;
+	std::vector<uint32_t> ranges;
+	std::vector<uint32_t> indices;
+
+	void setProjection(const glm::mat4& projection)
+	{
+		orthographic = projection[3][3] == 1.0f;
+		if (orthographic)
+		{
+			nearPlane = (projection[3][2] + 1.0f) / projection[2][2];
+			farPlane = (projection[3][2] - 1.0f) / projection[2][2];
+		}
+		else
+		{
+			nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+			farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+		}
+		halfExtent[0] = 1.0f / projection[0][0];
+		halfExtent[1] = 1.0f / projection[1][1];
+		for (int slice = 0; slice <= CLUSTER_SLICES; slice++)
+			sliceDepths[slice] = nearPlane * std::pow(farPlane / nearPlane, (float)slice / CLUSTER_SLICES);
+		lastProjection = projection;
+	}
+
+	// Scale from NDC to view space at a depth, the frustum widens with depth unless orthographic
+	float getExtent(int axis, float depth) const
+	{
+		return halfExtent[axis] * (orthographic ? 1.0f : depth);
+	}
+
+	int getSlice(float depth) const
+	{
+		int slice = (int)std::floor(std::log(depth / nearPlane) * CLUSTER_SLICES / std::log(farPlane / nearPlane));
+		return std::min(std::max(slice, 0), CLUSTER_SLICES - 1);
+	}
+
+	// Fill the lists of every cluster in slices first..last-1, each job owns its slices
+	void assignSlices(int first, int last)
+	{
+		for (int cluster = first * CLUSTER_TILES_X * CLUSTER_TILES_Y; cluster < last * CLUSTER_TILES_X * CLUSTER_TILES_Y; cluster++)
+			clusterLists[cluster].clear();
+
+		for (size_t i = 0; i < viewLights.size(); i++)
+		{
+			glm::vec3 center(viewLights[i]);
+			float radius = viewLights[i].w;
+			// depth is the distance in front of the camera, view space looks down -z
+			float minDepth = -center.z - radius;
+			float maxDepth = -center.z + radius;
+			if (maxDepth < nearPlane || minDepth > farPlane)
+				continue;
+			int firstSlice = std::max(getSlice(std::max(minDepth, nearPlane)), first);
+			int lastSlice = std::min(getSlice(std::min(maxDepth, farPlane)), last - 1);
+
+			for (int slice = firstSlice; slice <= lastSlice; slice++)
+			{
+				float sliceNear = std::max(sliceDepths[slice], minDepth);
+				float sliceFar = std::min(sliceDepths[slice + 1], maxDepth);
+				if (sliceNear > sliceFar)
+					continue;
+
+				// x / depth is monotonic in depth, so the sphere's screen extent within the
+				// slice is bounded by its view space box at the slice's near and far depth
+				int tileMin[2], tileMax[2];
+				for (int axis = 0; axis < 2; axis++)
+				{
+					int tiles = axis == 0 ? CLUSTER_TILES_X : CLUSTER_TILES_Y;
+					float low = std::min((center[axis] - radius) / getExtent(axis, sliceNear), (center[axis] - radius) / getExtent(axis, sliceFar));
+					float high = std::max((center[axis] + radius) / getExtent(axis, sliceNear), (center[axis] + radius) / getExtent(axis, sliceFar));
+					tileMin[axis] = std::max((int)std::floor((low * 0.5f + 0.5f) * tiles), 0);
+					tileMax[axis] = std::min((int)std::floor((high * 0.5f + 0.5f) * tiles), tiles - 1);
+				}
+
+				for (int y = tileMin[1]; y <= tileMax[1]; y++)
+				{
+					for (int x = tileMin[0]; x <= tileMax[0]; x++)
+					{
+						if (sphereTouchesCluster(center, radius, x, y, slice))
+							clusterLists[(slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x].push_back((uint32_t)i);
+					}
+				}
+			}
+		}
+	}
+
+	// Sphere against the view space bounding box of a cluster
+	bool sphereTouchesCluster(const glm::vec3& center, float radius, int x, int y, int slice) const
+	{
+		float sliceNear = sliceDepths[slice];
+		float sliceFar = sliceDepths[slice + 1];
+		glm::vec3 boxMin, boxMax;
+		for (int axis = 0; axis < 2; axis++)
+		{
+			int tiles = axis == 0 ? CLUSTER_TILES_X : CLUSTER_TILES_Y;
+			int tile = axis == 0 ? x : y;
+			float low = (float)tile / tiles * 2.0f - 1.0f;
+			float high = (float)(tile + 1) / tiles * 2.0f - 1.0f;
+			boxMin[axis] = std::min(low * getExtent(axis, sliceNear), low * getExtent(axis, sliceFar));
+			boxMax[axis] = std::max(high * getExtent(axis, sliceNear), high * getExtent(axis, sliceFar));
+		}
+		boxMin.z = -sliceFar;
+		boxMax.z = -sliceNear;
+
+		glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+		glm::vec3 offset = center - closest;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <memory>
+#include <vector>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "instancing.h"
+#include "job_system.h"
+#include "meshes.h"
+#include "scene.h"
+
+// Nodes per job when the world bounds are recomputed in parallel
+const size_t CULLING_BOUNDS_GRAIN = 256;
+
+// View frustum culling of scene nodes. World space bounds are cached per node and only
+// recomputed for nodes whose transform changed. A BVH over the node boxes is refitted after
+// every change and rebuilt when refitting has made it too loose; each frame it is walked
+// against the frustum so whole off screen regions are rejected with one test, and nodes in
+// subtrees that are entirely visible are accepted without any.
+class FrustumCuller
+{
+public:
+	// Bring the world bounds up to date, call after Scene::updateTransforms() changed anything.
+	// The nodes are transformed in parallel on jobs if given.
+	void updateBounds(const Scene& scene, const std::vector<std::shared_ptr<Drawable>>& meshes, JobSystem* jobs = NULL)
+	{
+		bool rebuild = boxes.size() != scene.nodes.size();
+		spheres.resize(scene.nodes.size());
+		boxes.resize(scene.nodes.size());
+		changed.clear();
+		for (size_t i = 0; i < scene.nodes.size(); i++)
+		{
+			if (rebuild || scene.nodes[i].worldChanged)
+				changed.push_back((int)i);
+		}
+
+		parallelFor(jobs, 0, changed.size(), CULLING_BOUNDS_GRAIN, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++)
+			{
+				int i = changed[c];
+				const SceneNode& node = scene.nodes[i];
+				if (node.mesh < 0 || node.pass == PASS_NONE)
+				{
+					// nothing drawn, an empty box keeps the node out of the tree
+					boxes[i].min = glm::vec3(FLT_MAX);
+					boxes[i].max = glm::vec3(-FLT_MAX);
+					continue;
+				}
+				spheres[i] = transformBoundingSphere(meshes[node.mesh]->getBoundingSphere(), node.worldMatrix);
+				boxes[i] = transformBoundingBox(meshes[node.mesh]->getBoundingBox(), node.worldMatrix);
+			}
+		});
+		// only the changed leaves and their ancestors are refitted
+		if (rebuild || !bvh.refit(boxes, changed))
+			bvh.build(boxes);
+	}
+
+	// Flag the nodes of instanceNodes that can be seen, returns how many were culled
+	int cull(const Frustum& frustum, const std::vector<int>& instanceNodes, std::vector<unsigned char>& visible)
+	{
+		nodeVisible.assign(boxes.size(), 0);
+		bvh.queryFrustum(frustum, [this](int node) {
+			nodeVisible[node] = 1;
+		}, [this, &frustum](int node) {
+			// leaf straddling a plane: sphere first, the box only if the sphere is not conclusive
+			Frustum_Test result = frustum.test(spheres[node]);
+			if (result == FRUSTUM_INTERSECTS)
+				result = frustum.test(boxes[node]);
+			nodeVisible[node] = result != FRUSTUM_OUTSIDE;
+		});
+
+		int culled = 0;
+		visible.resize(instanceNodes.size());
+		for (size_t i = 0; i < instanceNodes.size(); i++)
+		{
+			visible[i] = nodeVisible[instanceNodes[i]];
+			if (!visible[i])
+				culled++;
+		}
+		return culled;
+	}
+
+	// Closest drawn node hit by the ray (by its world box), -1 if there is none within maxDistance
+	int pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance = NULL) const
+	{
+		return bvh.raycast(origin, direction, maxDistance, [this](int node, const glm::vec3& rayOrigin, const glm::vec3& rayDirection) {
+			glm::vec3 inverse(1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z);
+			float entry;
+			return BVH::intersectRay(boxes[node], rayOrigin, inverse, FLT_MAX, entry) ? entry : -1.0f;
+		}, distance);
+	}
+
+	const BoundingSphere& getWorldSphere(int node) const { return spheres[node]; }
+	const BoundingBox& getWorldBox(int node) const { return boxes[node]; }
+	// nodes with bounds, 0 before the first updateBounds()
+	size_t getNodeCount() const { return boxes.size(); }
+	const BVH& getBVH() const { return bvh; }
+
+private:
+	std::vector<BoundingSphere> spheres;
+	std::vector<BoundingBox> boxes;
+	std::vector<unsigned char> nodeVisible;
+	std::vector<int> changed;	// nodes updateBounds() recomputed
+	BVH bvh;
+};
+
+// Copy the visible instances of every batch to the front of the batch's range, ordered by their
+// level of detail (lods, one per instance; all level 0 when empty). visibleBatches keeps one
+// entry per batch (so batch indices stay valid) with the visible counts, batches with nothing
+// visible end up with a count of 0.
+inline void compactVisibleInstances(const std::vector<InstanceData>& instances, const std::vector<InstanceBatch>& batches,
+	const std::vector<unsigned char>& visible, const std::vector<unsigned char>& lods,
+	std::vector<InstanceData>& visibleInstances, std::vector<InstanceBatch>& visibleBatches)
+{
+	visibleInstances.clear();
+	visibleBatches = batches;
+	for (size_t b = 0; b < batches.size(); b++)
+	{
+		InstanceBatch& batch = visibleBatches[b];
+		batch.first = visibleInstances.size();
+		batch.count = 0;
+		for (int level = 0; level < MAX_MESH_LODS; level++)
+		{
+			batch.lodCounts[level] = 0;
+			for (size_t i = batches[b].first; i < batches[b].first + batches[b].count; i++)
+			{
+				if (!visible[i] || (lods.empty() ? 0 : lods[i]) != level)
+					continue;
+				visibleInstances.push_back(instances[i]);
+				batch.lodCounts[level]++;
+			}
+			batch.count += batch.lodCounts[level];
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,75 @@
+// Micro-benchmark for the image flip used when loading textures.
+// Compares the original byte-by-byte flip with the row-at-a-time and banded multithreaded versions
+// on a 4K RGBA image and checks they all produce the same result.
+//
+// Build on its own, e.g.: g++ -O2 -std=c++11 -pthread flip_benchmark.cpp -o flip_benchmark
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "image_flip.h"
+
+typedef void (*FlipFunction)(unsigned char*, int, int, int);
+
+const int IMAGE_WIDTH = 3840;
+const int IMAGE_HEIGHT = 2160;
+const int IMAGE_CHANNELS = 4;
+const int ITERATIONS = 20;
+
+void flipParallel(unsigned char* image, int width, int height, int channels)
+{
+	flipImageVerticallyParallel(image, width, height, channels);
+}
+
+// Average milliseconds per flip
+double timeFlip(FlipFunction flip, std::vector<unsigned char>& image)
+{
+	// one warm up run so every version starts with the image in the same cache state
+	flip(image.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_CHANNELS);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < ITERATIONS; i++)
+		flip(image.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_CHANNELS);
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+}
+
+int main()
+{
+	std::vector<unsigned char> source((size_t)IMAGE_WIDTH * IMAGE_HEIGHT * IMAGE_CHANNELS);
+	for (size_t i = 0; i < source.size(); i++)
+		source[i] = (unsigned char)(rand() & 0xff);
+
+	// every version must flip exactly like the original
+	std::vector<unsigned char> expected = source;
+	flipImageVerticallyScalar(expected.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_CHANNELS);
+
+	struct Candidate { const char* name; FlipFunction flip; };
+	const Candidate candidates[] = {
+		{ "scalar (original)", flipImageVerticallyScalar },
+		{ "row memcpy", flipImageVertically },
+		{ "row memcpy, threaded", flipParallel }
+	};
+
+	std::cout << "Flipping " << IMAGE_WIDTH << "x" << IMAGE_HEIGHT << "x" << IMAGE_CHANNELS << ", " << ITERATIONS << " iterations" << std::endl;
+	double baseline = 0.0;
+	bool allMatch = true;
+	for (const Candidate& candidate : candidates)
+	{
+		std::vector<unsigned char> check = source;
+		candidate.flip(check.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_CHANNELS);
+		bool matches = check == expected;
+		allMatch = allMatch && matches;
+
+		std::vector<unsigned char> image = source;
+		double ms = timeFlip(candidate.flip, image);
+		if (baseline == 0.0)
+			baseline = ms;
+
+		std::cout << "  " << candidate.name << ": " << ms << " ms (" << baseline / ms << "x)"
+			<< (matches ? "" : "  MISMATCH") << std::endl;
+	}
+	return allMatch ? 0 : 1;
+}
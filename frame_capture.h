@@ -0,0 +1,265 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+// Source.cpp includes stb_image_write.h with STB_IMAGE_WRITE_IMPLEMENTATION, only pull in the declarations once
+#ifndef INCLUDE_STB_IMAGE_WRITE_H
+#include "stb_image_write.h"
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "job_system.h"
+
+// Create the folder frames are written to, fine if it already exists
+inline void createOutputDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+// Offscreen framebuffer with an RGBA8 color and a depth/stencil renderbuffer
+class RenderTarget
+{
+public:
+	RenderTarget(int width, int height) : width(width), height(height)
+	{
+		glGenFramebuffers(1, &FBO);
+		glGenRenderbuffers(1, &colorBuffer);
+		glGenRenderbuffers(1, &depthBuffer);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	~RenderTarget()
+	{
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+	}
+
+	void bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, width, height);
+	}
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+private:
+	GLuint FBO = 0, colorBuffer = 0, depthBuffer = 0;
+	int width, height;
+
+	RenderTarget(const RenderTarget&);
+	RenderTarget& operator=(const RenderTarget&);
+};
+
+// Reads rendered frames back without stalling the GPU and writes them as a PNG sequence.
+// capture() only queues a glReadPixels into the next pixel buffer of a ring; the pixels are
+// copied out a few frames later, once the buffer's fence has passed, and encoded in background
+// jobs. With outputDirectory empty the frames are read back but not written, which still
+// measures the full readback cost.
+class FrameCapture
+{
+public:
+	// jobs has to outlive the capture
+	FrameCapture(JobSystem& jobs, int width, int height, const std::string& outputDirectory, int numPixelBuffers = 3)
+		: jobs(jobs), width(width), height(height), outputDirectory(outputDirectory)
+	{
+		slots.resize(std::max(1, numPixelBuffers));
+		for (Slot& slot : slots)
+		{
+			glGenBuffers(1, &slot.pixelBuffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, getFrameSize(), NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		// bound the queue so a slow disk holds the renderer back instead of filling memory
+		maxQueuedFrames = (size_t)jobs.getThreadCount() * 2;
+	}
+
+	~FrameCapture()
+	{
+		finish();
+		for (Slot& slot : slots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			glDeleteBuffers(1, &slot.pixelBuffer);
+		}
+	}
+
+	// Queue a readback of the currently bound read framebuffer as frame number frameIndex
+	void capture(int frameIndex)
+	{
+		// the ring is full when the oldest slot is still waiting, that one has to be collected first
+		Slot& slot = slots[nextSlot];
+		if (slot.fence)
+			collect(slot, true);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frameIndex = frameIndex;
+		nextSlot = (nextSlot + 1) % slots.size();
+
+		// pick up anything that already finished so the writers stay busy
+		for (Slot& other : slots)
+		{
+			if (other.fence)
+				collect(other, false);
+		}
+	}
+
+	// Collect every outstanding readback and wait for the PNGs to be written. Frames that could
+	// not be written are reported here, on the calling thread.
+	void finish()
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			Slot& slot = slots[(nextSlot + i) % slots.size()];
+			if (slot.fence)
+				collect(slot, true);
+		}
+		jobs.wait(writing);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const std::string& path : failedFrames)
+			std::cout << "Failed to write frame " << path << std::endl;
+		failedFrames.clear();
+	}
+
+	int getFramesCaptured() const { return framesCaptured; }
+	int getFramesWritten() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return framesWritten;
+	}
+
+private:
+	struct Slot
+	{
+		GLuint pixelBuffer = 0;
+		GLsync fence = 0;
+		int frameIndex = 0;
+	};
+
+	struct Frame
+	{
+		int index;
+		std::vector<unsigned char> pixels;
+	};
+
+	JobSystem& jobs;
+	int width, height;
+	std::string outputDirectory;
+	std::vector<Slot> slots;
+	size_t nextSlot = 0;
+	int framesCaptured = 0;
+
+	JobCounter writing;
+	mutable std::mutex mutex;
+	std::condition_variable frameWritten;
+	size_t queuedFrames = 0;	// frames handed to a job and not written yet
+	size_t maxQueuedFrames = 2;
+	int framesWritten = 0;
+	std::vector<std::string> failedFrames;
+
+	GLsizeiptr getFrameSize() const
+	{
+		return (GLsizeiptr)width * height * 4;
+	}
+
+	// Copy a finished readback out of its pixel buffer. Without wait it gives up if the GPU is not done yet.
+	bool collect(Slot& slot, bool wait)
+	{
+		GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+		while (wait && result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		if (result == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		framesCaptured++;
+
+		Frame frame;
+		frame.index = slot.frameIndex;
+		frame.pixels.resize((size_t)getFrameSize());
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, getFrameSize(), GL_MAP_READ_BIT);
+		if (mapped)
+		{
+			std::memcpy(frame.pixels.data(), mapped, frame.pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (outputDirectory.empty())
+			return true;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frameWritten.wait(lock, [this]() { return queuedFrames < maxQueuedFrames; });
+			queuedFrames++;
+		}
+		jobs.runInBackground(writing, [this, frame = std::move(frame)]() { write(frame); });
+		return true;
+	}
+
+	// Background job: encode the PNG. GL rows start at the bottom, so the rows are handed to
+	// the encoder last one first with a negative stride instead of flipping them.
+	void write(const Frame& frame)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/frame_%05d.png", frame.index);
+		std::string path = outputDirectory + name;
+		const unsigned char* lastRow = frame.pixels.data() + (size_t)(height - 1) * width * 4;
+		bool written = stbi_write_png(path.c_str(), width, height, 4, lastRow, -width * 4) != 0;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (written)
+				framesWritten++;
+			else
+				failedFrames.push_back(path);
+			queuedFrames--;
+		}
+		frameWritten.notify_all();
+	}
+
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "bounds.h"
+#include "instancing.h"
+#include "multi_draw.h"
+#include "render_queue.h"
+
+// Everything about one frame that goes from the simulation stage through the visibility stage
+// to GL submission. The render loop keeps two: while the main thread submits one frame, the
+// visibility stage fills the other for the frame after it as a job, so neither touches the other's.
+struct FrameData
+{
+	// simulation stage: the camera and lights as they were when this frame was simulated
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	glm::vec3 eye = glm::vec3(0.0f);
+	glm::vec3 forward = glm::vec3(0.0f, 0.0f, -1.0f);
+	float viewportHeight = 0.0f;	// pixels, the levels of detail are picked for it
+	std::vector<glm::vec3> lightPositions;
+	// where moved shadow casters were and are, see collectMovedCasters()
+	std::vector<BoundingBox> movedCasters;
+	// set when the instances were rebuilt: casters holds a copy of them for the shadow maps
+	bool instancesChanged = false;
+	std::vector<InstanceData> casterInstances;
+	std::vector<InstanceBatch> casterBatches;
+	// the view or the instances changed since the frame before
+	bool viewChanged = false;
+	// set when the visibility stage ran, otherwise the last uploaded draws are still current
+	bool visibilityChanged = false;
+
+	// visibility stage
+	std::vector<unsigned char> visible;
+	std::vector<unsigned char> lods;
+	std::vector<InstanceData> visibleInstances;
+	std::vector<InstanceBatch> visibleBatches;
+	RenderQueue queue;
+	DrawList draws;
+	RenderQueue casterQueue;
+	DrawList casterDraws;
+	int culledInstances = 0;
+	int occludedInstances = 0;
+	double visibilityTime = 0.0;	// ms spent in the visibility stage
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+
+// Headless OpenGL 3.3 core context for machines without a display. EGL is used by default, it
+// runs on a GPU or on Mesa's llvmpipe through the surfaceless platform. Build with
+// HEADLESS_OSMESA defined (and link OSMesa instead of EGL) for a pure software context.
+// Nothing is presented; the application renders into its own framebuffer (see frame_capture.h).
+#ifdef HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+class HeadlessContext
+{
+public:
+	HeadlessContext() {}
+	~HeadlessContext() { destroy(); }
+
+	// Create the context and make it current, then load the GL functions through glad
+	bool create()
+	{
+#ifdef HEADLESS_OSMESA
+		const int attributes[] = {
+			OSMESA_FORMAT, OSMESA_RGBA,
+			OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+			OSMESA_CONTEXT_MAJOR_VERSION, 3,
+			OSMESA_CONTEXT_MINOR_VERSION, 3,
+			0
+		};
+		context = OSMesaCreateContextAttribs(attributes, NULL);
+		if (!context)
+		{
+			std::cout << "Failed to create OSMesa context" << std::endl;
+			return false;
+		}
+		// OSMesa needs a buffer to make the context current, the frames go to an FBO so 1x1 is enough
+		buffer.resize(4);
+		if (!OSMesaMakeCurrent(context, buffer.data(), GL_UNSIGNED_BYTE, 1, 1))
+		{
+			std::cout << "Failed to make OSMesa context current" << std::endl;
+			return false;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)OSMesaGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return false;
+		}
+#else
+		// prefer the surfaceless platform, it works without X, Wayland or a DRM device
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		{
+			std::cout << "Failed to initialize EGL" << std::endl;
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+		{
+			std::cout << "Failed to find an EGL config" << std::endl;
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		eglBindAPI(EGL_OPENGL_API);
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT)
+		{
+			std::cout << "Failed to create EGL context" << std::endl;
+			return false;
+		}
+
+		// no surface at all if the driver allows it, otherwise a tiny pbuffer to be current on
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+			if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+			{
+				std::cout << "Failed to make EGL context current" << std::endl;
+				return false;
+			}
+		}
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return false;
+		}
+#endif
+		return true;
+	}
+
+	void destroy()
+	{
+#ifdef HEADLESS_OSMESA
+		if (context)
+			OSMesaDestroyContext(context);
+		context = NULL;
+#else
+		if (display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (surface != EGL_NO_SURFACE)
+				eglDestroySurface(display, surface);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+		}
+		display = EGL_NO_DISPLAY;
+		surface = EGL_NO_SURFACE;
+		context = EGL_NO_CONTEXT;
+#endif
+	}
+
+private:
+#ifdef HEADLESS_OSMESA
+	OSMesaContext context = NULL;
+	std::vector<unsigned char> buffer;
+#else
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+	HeadlessContext(const HeadlessContext&);
+	HeadlessContext& operator=(const HeadlessContext&);
+};
+
+#endif
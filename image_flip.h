@@ -0,0 +1,86 @@
+#ifndef IMAGE_FLIP_H
+#define IMAGE_FLIP_H
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Row swaps go through a small stack buffer in chunks of this size, big enough for memcpy to run
+// at full (vectorized) speed and small enough to stay in L1
+const size_t FLIP_CHUNK_BYTES = 4096;
+
+// Images smaller than this are not worth spreading over threads
+const size_t FLIP_PARALLEL_MIN_BYTES = 4 * 1024 * 1024;
+
+// Original byte-by-byte flip, kept as the reference for flip_benchmark.cpp
+inline void flipImageVerticallyScalar(unsigned char* image, int width, int height, int channels)
+{
+	for (int j = 0; j < height / 2; ++j)
+	{
+		int index1 = j * width * channels;
+		int index2 = (height - 1 - j) * width * channels;
+
+		for (int i = width * channels; i > 0; --i)
+		{
+			unsigned char tmp = image[index1];
+			image[index1] = image[index2];
+			image[index2] = tmp;
+			++index1;
+			++index2;
+		}
+	}
+}
+
+// Swap the rows firstRow..lastRow-1 (all in the top half) with their mirrored rows
+inline void flipImageRows(unsigned char* image, size_t rowBytes, int height, int firstRow, int lastRow)
+{
+	unsigned char scratch[FLIP_CHUNK_BYTES];
+	for (int j = firstRow; j < lastRow; ++j)
+	{
+		unsigned char* top = image + (size_t)j * rowBytes;
+		unsigned char* bottom = image + (size_t)(height - 1 - j) * rowBytes;
+		for (size_t offset = 0; offset < rowBytes; offset += FLIP_CHUNK_BYTES)
+		{
+			size_t bytes = std::min(FLIP_CHUNK_BYTES, rowBytes - offset);
+			std::memcpy(scratch, top + offset, bytes);
+			std::memcpy(top + offset, bottom + offset, bytes);
+			std::memcpy(bottom + offset, scratch, bytes);
+		}
+	}
+}
+
+// Flip images for texturing, a whole row at a time
+inline void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+	flipImageRows(image, (size_t)width * channels, height, 0, height / 2);
+}
+
+// Same flip split into bands of rows, one per thread. Falls back to the single threaded
+// version for small images where starting threads costs more than it saves.
+inline void flipImageVerticallyParallel(unsigned char* image, int width, int height, int channels, int numThreads = 0)
+{
+	size_t rowBytes = (size_t)width * channels;
+	int halfHeight = height / 2;
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	numThreads = std::min(numThreads, std::max(1, halfHeight));
+
+	if (numThreads == 1 || rowBytes * height < FLIP_PARALLEL_MIN_BYTES)
+	{
+		flipImageRows(image, rowBytes, height, 0, halfHeight);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	int rowsPerBand = (halfHeight + numThreads - 1) / numThreads;
+	for (int first = 0; first < halfHeight; first += rowsPerBand)
+	{
+		int last = std::min(first + rowsPerBand, halfHeight);
+		threads.push_back(std::thread(flipImageRows, image, rowBytes, height, first, last));
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+#endif
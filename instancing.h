@@ -0,0 +1,145 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "mesh_data.h"
+#include "meshes.h"
+#include "ring_buffer.h"
+#include "scene.h"
+
+// First vertex attribute location used by per instance data, locations 0-2 belong to the meshes.
+// The model matrix takes four locations (one per column), the material index the one after.
+// The position decode of the instance's mesh goes to POSITION_SCALE_ATTRIBUTE and
+// POSITION_OFFSET_ATTRIBUTE (see vertex_format.h).
+const GLuint INSTANCE_MODEL_ATTRIBUTE = 3;
+const GLuint INSTANCE_MATERIAL_ATTRIBUTE = 7;
+
+// Per instance data, must match the instanced vertex shaders
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::vec3 positionScale;
+	GLint material;		// TextureArray layer of the instance, -1 (untextured) samples layer 0
+	glm::vec3 positionOffset;
+	GLint padding;
+};
+
+// A contiguous run of instances sharing mesh and shader pass, drawn with one instanced call per
+// level of detail. Textures are layers of one array, so they do not split batches. The
+// instances are ordered by level: lodCounts[0] at level 0 first, then lodCounts[1] at level 1
+// and so on.
+struct InstanceBatch
+{
+	Scene_Pass pass;
+	int mesh;
+	size_t first;
+	size_t count;
+	size_t lodCounts[MAX_MESH_LODS];
+};
+
+// Group every drawable scene node into batches. The instance array is sorted so each batch is
+// one contiguous range, which is then uploaded once and drawn with a single instanced call.
+// Batches are ordered by pass, so each pass is one multi-draw (see multi_draw.h).
+// instanceNodes, if given, receives the scene node of every instance.
+inline void buildInstanceBatches(const Scene& scene, const std::vector<std::shared_ptr<Drawable>>& meshes,
+	std::vector<InstanceData>& instances, std::vector<InstanceBatch>& batches, std::vector<int>* instanceNodes = NULL)
+{
+	std::vector<int> order;
+	for (size_t i = 0; i < scene.nodes.size(); i++)
+	{
+		if (scene.nodes[i].pass != PASS_NONE && scene.nodes[i].mesh >= 0)
+			order.push_back((int)i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&scene](int a, int b) {
+		const SceneNode& na = scene.nodes[a];
+		const SceneNode& nb = scene.nodes[b];
+		if (na.pass != nb.pass)
+			return na.pass < nb.pass;
+		return na.mesh < nb.mesh;
+	});
+
+	instances.clear();
+	batches.clear();
+	if (instanceNodes)
+		instanceNodes->assign(order.begin(), order.end());
+	for (int index : order)
+	{
+		const SceneNode& node = scene.nodes[index];
+		if (batches.empty() || batches.back().pass != node.pass || batches.back().mesh != node.mesh)
+		{
+			InstanceBatch batch = { node.pass, node.mesh, instances.size(), 0, {} };
+			batches.push_back(batch);
+		}
+
+		InstanceData data;
+		data.model = node.worldMatrix;
+		data.positionScale = meshes[node.mesh]->getPositionScale();
+		data.material = node.texture;
+		data.positionOffset = meshes[node.mesh]->getPositionOffset();
+		data.padding = 0;
+		instances.push_back(data);
+		batches.back().count++;
+		batches.back().lodCounts[0]++;
+	}
+}
+
+// GPU copy of the instance array. Meshes read from it through instanced attributes that are
+// pointed at the batch being drawn, so one buffer serves every mesh in the scene. Uploads go
+// through a RingBuffer, so they are a single memcpy into persistently mapped memory where the
+// driver supports it.
+class InstanceBuffer
+{
+public:
+	void upload(const std::vector<InstanceData>& instances)
+	{
+		if (instances.empty())
+			return;
+		base = ring.write(instances.data(), instances.size() * sizeof(InstanceData));
+	}
+
+	// Point the instanced attributes of the bound mesh VAO at instances starting from first
+	void bind(size_t first) const
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, ring.getBuffer());
+
+		size_t offset = base + first * sizeof(InstanceData);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			GLuint location = INSTANCE_MODEL_ATTRIBUTE + column;
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + column * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+		}
+		glVertexAttribIPointer(INSTANCE_MATERIAL_ATTRIBUTE, 1, GL_INT, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, material)));
+		glEnableVertexAttribArray(INSTANCE_MATERIAL_ATTRIBUTE);
+		glVertexAttribDivisor(INSTANCE_MATERIAL_ATTRIBUTE, 1);
+		glVertexAttribPointer(POSITION_SCALE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, positionScale)));
+		glEnableVertexAttribArray(POSITION_SCALE_ATTRIBUTE);
+		glVertexAttribDivisor(POSITION_SCALE_ATTRIBUTE, 1);
+		glVertexAttribPointer(POSITION_OFFSET_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, positionOffset)));
+		glEnableVertexAttribArray(POSITION_OFFSET_ATTRIBUTE);
+		glVertexAttribDivisor(POSITION_OFFSET_ATTRIBUTE, 1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// after the last draw of the frame, see RingBuffer::endFrame()
+	void endFrame()
+	{
+		ring.endFrame();
+	}
+
+private:
+	RingBuffer ring;
+	size_t base = 0;
+};
+
+#endif
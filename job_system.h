@@ -0,0 +1,324 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Jobs one thread's deque holds, run() executes the job on the spot when it is full
+const int JOB_DEQUE_CAPACITY = 4096;
+// parallelFor() cuts a range into at most this many chunks per job thread, so threads that
+// finish early have something left to steal
+const int JOB_CHUNKS_PER_THREAD = 4;
+
+// How many jobs of a group are still unfinished: run() adds one, finishing the job takes it off
+// again. JobSystem::wait() returns once it is back to 0; a job that depends on the results of
+// other jobs waits on their counter.
+class JobCounter
+{
+public:
+	bool isDone() const { return count.load() == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> count{ 0 };
+};
+
+// Fixed size pool of worker threads sharing the engine's CPU work. Every job thread (the workers
+// and the thread that created the pool) has its own deque: jobs it queues go to the bottom of
+// it and it takes them back from there, while idle threads steal from the top of the others'.
+// Waiting for a counter runs queued jobs instead of blocking. Long jobs that should not end up
+// on a waiting thread, like decoding a file, go through runInBackground() to a shared queue
+// only the workers take from; so do jobs queued from threads that are not job threads.
+class JobSystem
+{
+public:
+	// numWorkers <= 0 starts one per core besides the calling thread
+	explicit JobSystem(int numWorkers = 0)
+	{
+		if (numWorkers <= 0)
+			numWorkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		for (int i = 0; i <= numWorkers; i++)
+			deques.push_back(std::unique_ptr<JobDeque>(new JobDeque()));
+
+		// the creating thread owns deque 0, the workers the rest
+		getThreadSlot() = ThreadSlot{ this, 0 };
+		for (int i = 1; i <= numWorkers; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+
+		// the workers leave nothing queued behind them, only the creating thread's deque can
+		// still hold jobs nobody waited for
+		while (Job* job = deques[0]->pop())
+			execute(job);
+		if (getThreadSlot().system == this)
+			getThreadSlot() = ThreadSlot{ NULL, -1 };
+	}
+
+	// Queue a job of counter. Any job thread may run it, including one waiting in wait() or
+	// parallelFor(), so it should not take long.
+	void run(JobCounter& counter, std::function<void()> function)
+	{
+		int index = getThreadIndex();
+		if (index < 0)
+		{
+			runInBackground(counter, std::move(function));
+			return;
+		}
+
+		Job* job = new Job{ std::move(function), &counter };
+		counter.count++;
+		queued++;
+		if (!deques[index]->push(job))
+		{
+			queued--;
+			execute(job);
+			return;
+		}
+		wakeWorker();
+	}
+
+	// Queue a long running job of counter, only the workers run it, oldest first. An urgent job
+	// goes ahead of the ones already queued, e.g. a frame's work ahead of texture decoding.
+	void runInBackground(JobCounter& counter, std::function<void()> function, bool urgent = false)
+	{
+		Job* job = new Job{ std::move(function), &counter };
+		counter.count++;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (urgent)
+				backgroundJobs.push_front(job);
+			else
+				backgroundJobs.push_back(job);
+		}
+		queued++;
+		wakeWorker();
+	}
+
+	// Return once every job of counter is done. A job thread runs queued jobs in the meantime.
+	void wait(const JobCounter& counter)
+	{
+		int index = getThreadIndex();
+		while (counter.count.load() > 0)
+		{
+			Job* job = index >= 0 ? findJob(index, false) : NULL;
+			if (job)
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	// Call function(first, last) over [begin, end) in chunks of at least grain indices, spread
+	// over the job threads. The calling thread does its share and returns when all are done.
+	template<typename Function>
+	void parallelFor(size_t begin, size_t end, size_t grain, const Function& function)
+	{
+		if (end <= begin)
+			return;
+		size_t count = end - begin;
+		size_t maxChunks = deques.size() * JOB_CHUNKS_PER_THREAD;
+		size_t chunk = std::max(std::max<size_t>(grain, 1), (count + maxChunks - 1) / maxChunks);
+		// too small to split, or called from a thread that cannot help with the chunks
+		if (chunk >= count || getThreadIndex() < 0)
+		{
+			function(begin, end);
+			return;
+		}
+
+		JobCounter counter;
+		for (size_t first = begin + chunk; first < end; first += chunk)
+		{
+			size_t last = std::min(first + chunk, end);
+			run(counter, [&function, first, last]() { function(first, last); });
+		}
+		function(begin, begin + chunk);
+		wait(counter);
+	}
+
+	// Job threads, the workers and the creating thread
+	int getThreadCount() const { return (int)deques.size(); }
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	// Chase-Lev deque of fixed size: the owner pushes and pops at the bottom, thieves take from
+	// the top, both without locks. Everything is sequentially consistent, the simplest order
+	// that is correct for it.
+	class JobDeque
+	{
+	public:
+		bool push(Job* job)
+		{
+			long long b = bottom.load();
+			if (b - top.load() >= JOB_DEQUE_CAPACITY)
+				return false;
+			slots[b % JOB_DEQUE_CAPACITY].store(job);
+			bottom.store(b + 1);
+			return true;
+		}
+
+		// owner only, newest job first
+		Job* pop()
+		{
+			long long b = bottom.load() - 1;
+			bottom.store(b);
+			long long t = top.load();
+			if (t > b)
+			{
+				bottom.store(b + 1);
+				return NULL;
+			}
+			Job* job = slots[b % JOB_DEQUE_CAPACITY].load();
+			if (t == b)
+			{
+				// the last job, thieves may be after it too
+				if (!top.compare_exchange_strong(t, t + 1))
+					job = NULL;
+				bottom.store(b + 1);
+			}
+			return job;
+		}
+
+		// any thread, oldest job first; NULL if empty or another thread got there first
+		Job* steal()
+		{
+			long long t = top.load();
+			long long b = bottom.load();
+			if (t >= b)
+				return NULL;
+			Job* job = slots[t % JOB_DEQUE_CAPACITY].load();
+			if (!top.compare_exchange_strong(t, t + 1))
+				return NULL;
+			return job;
+		}
+
+	private:
+		std::atomic<long long> top{ 0 };
+		std::atomic<long long> bottom{ 0 };
+		std::atomic<Job*> slots[JOB_DEQUE_CAPACITY];
+	};
+
+	// which job system and deque the current thread belongs to
+	struct ThreadSlot
+	{
+		JobSystem* system;
+		int index;
+	};
+
+	std::vector<std::unique_ptr<JobDeque>> deques;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job*> backgroundJobs;
+	std::atomic<int> queued{ 0 };	// jobs in the deques and the background queue
+	std::atomic<int> sleeping{ 0 };
+	bool stopping = false;
+
+	static ThreadSlot& getThreadSlot()
+	{
+		static thread_local ThreadSlot slot = { NULL, -1 };
+		return slot;
+	}
+
+	// deque of the calling thread, -1 if it is not one of our job threads
+	int getThreadIndex() const
+	{
+		const ThreadSlot& slot = getThreadSlot();
+		return slot.system == this ? slot.index : -1;
+	}
+
+	// own deque first, then steal from the others, then (workers only) the background queue
+	Job* findJob(int index, bool takeBackground)
+	{
+		Job* job = deques[index]->pop();
+		for (size_t i = 1; !job && i < deques.size(); i++)
+			job = deques[(index + i) % deques.size()]->steal();
+		if (!job && takeBackground)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!backgroundJobs.empty())
+			{
+				job = backgroundJobs.front();
+				backgroundJobs.pop_front();
+			}
+		}
+		if (job)
+			queued--;
+		return job;
+	}
+
+	void execute(Job* job)
+	{
+		job->function();
+		// the waiter may destroy the counter as soon as it reaches 0
+		job->counter->count--;
+		delete job;
+	}
+
+	// queued is raised before this and sleeping before a worker checks queued, so either the
+	// worker sees the job or we see the worker
+	void wakeWorker()
+	{
+		if (sleeping.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			wake.notify_one();
+		}
+	}
+
+	void workerLoop(int index)
+	{
+		getThreadSlot() = ThreadSlot{ this, index };
+		for (;;)
+		{
+			Job* job = findJob(index, true);
+			if (job)
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			if (stopping && backgroundJobs.empty())
+				return;
+			sleeping++;
+			wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+			sleeping--;
+		}
+	}
+};
+
+// parallelFor() on jobs, or the whole range on the calling thread when there is no job system
+template<typename Function>
+inline void parallelFor(JobSystem* jobs, size_t begin, size_t end, size_t grain, const Function& function)
+{
+	if (jobs)
+		jobs->parallelFor(begin, end, grain, function);
+	else if (begin < end)
+		function(begin, end);
+}
+
+#endif
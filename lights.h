@@ -0,0 +1,182 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// A point light ends where it would add less than this to a color channel
+const float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+// Binding point shared by the C++ side and every shader that declares the "Lighting" block
+const GLuint LIGHTING_UBO_BINDING = 0;
+
+// Light structs laid out to match std140 exactly: every vec3 starts on a 16 byte boundary
+// and the following float fills the last 4 bytes of that slot. Point lights are read as four
+// vec4 texels each (see clustered_lights.h), which the same layout gives for free.
+struct PointLight
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float radius;	// the light fades out to nothing here, clusters use it as the light's extent
+};
+
+struct SpotLight
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 direction;
+	float linear;
+	glm::vec3 ambient;
+	float quadratic;
+	glm::vec3 diffuse;
+	float cutOff;
+	glm::vec3 specular;
+	float outerCutOff;
+};
+
+// The spot light lights every pixel, the point lights go through the clusters
+struct LightingBlock
+{
+	SpotLight spotLight;
+};
+
+static_assert(sizeof(PointLight) == 64, "PointLight does not match the std140 layout");
+static_assert(sizeof(SpotLight) == 80, "SpotLight does not match the std140 layout");
+
+// Distance at which attenuation brings a channel of the given brightness down to LIGHT_CUTOFF
+inline float getAttenuationRange(float constant, float linear, float quadratic, float brightest)
+{
+	// solve constant + linear * d + quadratic * d^2 = brightest / LIGHT_CUTOFF
+	float c = constant - brightest / LIGHT_CUTOFF;
+	if (c >= 0.0f)
+		return 0.0f;
+	if (quadratic <= 0.0f)
+		return linear > 0.0f ? -c / linear : 1e30f;
+	return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+}
+
+inline float getBrightestChannel(const glm::vec3& diffuse, const glm::vec3& specular)
+{
+	return std::max(std::max(std::max(diffuse.x, diffuse.y), std::max(diffuse.z, specular.x)), std::max(specular.y, specular.z));
+}
+
+// Distance at which the attenuation brings the brightest channel down to LIGHT_CUTOFF
+inline float getPointLightRadius(const PointLight& light)
+{
+	return getAttenuationRange(light.constant, light.linear, light.quadratic, getBrightestChannel(light.diffuse, light.specular));
+}
+
+// How far the spot light reaches along its cone, the same way
+inline float getSpotLightRange(const SpotLight& light)
+{
+	return getAttenuationRange(light.constant, light.linear, light.quadratic, getBrightestChannel(light.diffuse, light.specular));
+}
+
+// Build a point light with the usual attenuation terms, it reaches as far as they allow
+inline PointLight makePointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+	float constant = 1.0f, float linear = 0.09f, float quadratic = 0.032f)
+{
+	PointLight light;
+	light.position = position;
+	light.ambient = ambient;
+	light.diffuse = diffuse;
+	light.specular = specular;
+	light.constant = constant;
+	light.linear = linear;
+	light.quadratic = quadratic;
+	light.radius = getPointLightRadius(light);
+	return light;
+}
+
+// Build a point light of one color that reaches radius, with attenuation terms picked to
+// fall off smoothly up to there (the usual table of ranges, fitted)
+inline PointLight makePointLight(glm::vec3 position, glm::vec3 color, float radius)
+{
+	PointLight light = makePointLight(position, color * 0.05f, color * 0.8f, color, 1.0f, 4.5f / radius, 75.0f / (radius * radius));
+	light.radius = radius;
+	return light;
+}
+
+// Build a spotlight, cut off angles are given in degrees
+inline SpotLight makeSpotLight(glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+	float cutOffDegrees, float outerCutOffDegrees, float constant = 1.0f, float linear = 0.09f, float quadratic = 0.032f)
+{
+	SpotLight light;
+	light.position = position;
+	light.direction = direction;
+	light.ambient = ambient;
+	light.diffuse = diffuse;
+	light.specular = specular;
+	light.cutOff = glm::cos(glm::radians(cutOffDegrees));
+	light.outerCutOff = glm::cos(glm::radians(outerCutOffDegrees));
+	light.constant = constant;
+	light.linear = linear;
+	light.quadratic = quadratic;
+	return light;
+}
+
+// Uniform buffer holding the spot light. It is edited on the CPU copy and the buffer is only
+// re-uploaded when it actually changed since the last upload.
+class LightingBuffer
+{
+public:
+	LightingBuffer(GLuint binding = LIGHTING_UBO_BINDING) : binding(binding)
+	{
+		std::memset(static_cast<void*>(&block), 0, sizeof(block));
+
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingBlock), NULL, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	~LightingBuffer()
+	{
+		glDeleteBuffers(1, &UBO);
+	}
+
+	void setSpotLight(const SpotLight& light)
+	{
+		if (std::memcmp(&block.spotLight, &light, sizeof(SpotLight)) != 0)
+		{
+			block.spotLight = light;
+			dirty = true;
+		}
+	}
+
+	const SpotLight& getSpotLight() const { return block.spotLight; }
+
+	// Push the CPU copy to the GPU if anything changed, returns true if an upload happened
+	bool upload()
+	{
+		if (!dirty)
+			return false;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingBlock), &block);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		dirty = false;
+		return true;
+	}
+
+	GLuint getBinding() const { return binding; }
+
+private:
+	LightingBlock block;
+	GLuint UBO = 0;
+	GLuint binding;
+	bool dirty = true;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "culling.h"
+#include "job_system.h"
+#include "mesh_data.h"
+#include "meshes.h"
+#include "scene.h"
+
+// Projected diameter in pixels below which level i + 1 is used instead of level i
+const float LOD_SCREEN_SIZES[MAX_MESH_LODS - 1] = { 96.0f, 32.0f };
+// Switching only happens this far (0.15 = 15%) past a threshold, so an object sitting right at
+// one does not flip between two levels every frame
+const float LOD_HYSTERESIS = 0.15f;
+// Instances per job when levels are picked in parallel
+const size_t LOD_SELECT_GRAIN = 512;
+
+// Picks a level of detail for every visible instance from the screen size of its bounding
+// sphere. The level of every scene node is remembered between frames for the hysteresis.
+class LodSelector
+{
+public:
+	// Fill lods with the level of every instance, culled instances keep their last level.
+	// viewportHeight is in pixels. Every node has at most one instance, so the instances are
+	// split over jobs if given.
+	void select(const Scene& scene, const std::vector<std::shared_ptr<Drawable>>& meshes, const FrustumCuller& culler,
+		const std::vector<int>& instanceNodes, const std::vector<unsigned char>& visible,
+		const glm::mat4& projection, const glm::mat4& viewProjection, float viewportHeight, std::vector<unsigned char>& lods,
+		JobSystem* jobs = NULL)
+	{
+		levels.resize(scene.nodes.size(), 0);
+		lods.resize(instanceNodes.size());
+		parallelFor(jobs, 0, instanceNodes.size(), LOD_SELECT_GRAIN, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+			{
+				int node = instanceNodes[i];
+				int lodCount = meshes[scene.nodes[node].mesh]->getLodCount();
+				if (visible[i] && lodCount > 1)
+				{
+					float size = getScreenSize(culler.getWorldSphere(node), projection, viewProjection, viewportHeight);
+					int level = std::min((int)levels[node], lodCount - 1);
+					while (level < lodCount - 1 && size < LOD_SCREEN_SIZES[level] * (1.0f - LOD_HYSTERESIS))
+						level++;
+					while (level > 0 && size > LOD_SCREEN_SIZES[level - 1] * (1.0f + LOD_HYSTERESIS))
+						level--;
+					levels[node] = (unsigned char)level;
+				}
+				lods[i] = std::min((int)levels[node], lodCount - 1);
+			}
+		});
+	}
+
+	// Projected diameter of a sphere in pixels. Clip w is the view depth for a perspective
+	// projection and 1 for an orthographic one, so both work.
+	static float getScreenSize(const BoundingSphere& sphere, const glm::mat4& projection, const glm::mat4& viewProjection, float viewportHeight)
+	{
+		float w = viewProjection[0][3] * sphere.center.x + viewProjection[1][3] * sphere.center.y + viewProjection[2][3] * sphere.center.z + viewProjection[3][3];
+		// the camera is inside the sphere, draw it at full detail
+		if (w <= sphere.radius * std::fabs(projection[2][3]))
+			return viewportHeight;
+		return sphere.radius * projection[1][1] / w * viewportHeight;
+	}
+
+private:
+	std::vector<unsigned char> levels;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+#include "meshes.h"
+#include "mesh_data.h"
+#include "mesh_format.h"
+#include "mesh_pool.h"
+#include "mesh_optimizer.h"
+#include "scene.h"
+
+// Default folder holding baked .mesh files (see mesh_converter.cpp)
+const char* const DEFAULT_MESH_DIRECTORY = "meshes";
+
+// Registry handing out shared meshes, every one of them added to a MeshPool. The first request
+// for a key adds the geometry, later requests get the same mesh. Baked .mesh files are memory
+// mapped, which only makes reading them cheaper: they are copied into a MeshData like a
+// generated mesh before they go to the pool. Primitives without one are generated on the spot.
+// Spheres and cylinders come with their level of detail chain (getLodKeys), one baked file per
+// level. The pool never gives space back, so the cache keeps every mesh it made. Given a
+// JobSystem, the CPU side of new meshes (reading or generating and optimizing every level) is
+// spread over its jobs.
+class MeshCache
+{
+public:
+	// pool has to outlive the cache, call its upload() once the meshes are acquired
+	MeshCache(MeshPool& pool, const std::string& directory = DEFAULT_MESH_DIRECTORY, JobSystem* jobs = NULL)
+		: pool(pool), directory(directory), jobs(jobs) {}
+
+	std::shared_ptr<Drawable> acquire(const MeshKey& key)
+	{
+		auto it = entries.find(key);
+		if (it != entries.end())
+			return it->second;
+
+		std::shared_ptr<Drawable> mesh = create(key);
+		entries[key] = mesh;
+		return mesh;
+	}
+
+	// One mesh per desc, in order. The levels of all the meshes that are not cached yet are
+	// loaded in one go, so a scene of many small meshes keeps every job thread busy.
+	std::vector<std::shared_ptr<Drawable>> acquireAll(const std::vector<MeshDesc>& descs)
+	{
+		std::map<MeshKey, std::vector<MeshData>> prepared;
+		std::vector<MeshKey> levelKeys;
+		std::vector<MeshData*> levelMeshes;
+		for (const MeshDesc& desc : descs)
+		{
+			MeshKey key = makeMeshKey(desc);
+			auto it = entries.find(key);
+			if (it != entries.end() || prepared.count(key))
+				continue;
+			MeshKey lodKeys[MAX_MESH_LODS];
+			int lodCount = getLodKeys(key, lodKeys);
+			// the map's vectors are not resized again, so the pointers stay valid
+			std::vector<MeshData>& levels = prepared[key];
+			levels.resize(lodCount);
+			for (int level = 0; level < lodCount; level++)
+			{
+				levelKeys.push_back(lodKeys[level]);
+				levelMeshes.push_back(&levels[level]);
+			}
+		}
+		loadLevels(levelKeys.data(), levelMeshes.data(), levelKeys.size());
+
+		std::vector<std::shared_ptr<Drawable>> meshes;
+		for (const MeshDesc& desc : descs)
+		{
+			MeshKey key = makeMeshKey(desc);
+			auto it = prepared.find(key);
+			if (it == prepared.end())
+			{
+				meshes.push_back(acquire(key));
+				continue;
+			}
+			std::shared_ptr<Drawable> mesh = createChain(it->second);
+			entries[key] = mesh;
+			prepared.erase(it);
+			meshes.push_back(mesh);
+		}
+		return meshes;
+	}
+
+private:
+	MeshPool& pool;
+	std::string directory;
+	JobSystem* jobs;
+	std::map<MeshKey, std::shared_ptr<Drawable>> entries;
+
+	std::shared_ptr<Drawable> create(const MeshKey& key)
+	{
+		// spheres and cylinders get their coarser levels of detail in the same buffers
+		MeshKey lodKeys[MAX_MESH_LODS];
+		int lodCount = getLodKeys(key, lodKeys);
+		std::vector<MeshData> levels(lodCount);
+		MeshData* levelMeshes[MAX_MESH_LODS];
+		for (int level = 0; level < lodCount; level++)
+			levelMeshes[level] = &levels[level];
+		loadLevels(lodKeys, levelMeshes, lodCount);
+		return createChain(levels);
+	}
+
+	// The levels of detail of one mesh, finest first, in the same buffers
+	std::shared_ptr<Drawable> createChain(const std::vector<MeshData>& levels)
+	{
+		MeshData chain;
+		std::vector<MeshLod> lods;
+		for (const MeshData& mesh : levels)
+		{
+			MeshLod lod = { (uint32_t)chain.indices.size(), (uint32_t)mesh.indices.size() };
+			lods.push_back(lod);
+			chain.append(mesh);
+		}
+		return pool.add(chain, lods);
+	}
+
+	// loadMeshData() for count keys, spread over the jobs when there is a job system. What
+	// they have to report is printed here afterwards, in key order.
+	void loadLevels(const MeshKey* keys, MeshData* const* meshes, size_t count)
+	{
+		std::vector<std::string> messages(count);
+		parallelFor(jobs, 0, count, 1, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				loadMeshData(keys[i], *meshes[i], messages[i]);
+		});
+		for (const std::string& message : messages)
+			std::cout << message;
+	}
+
+	// imported models are named relative to the working directory, baked primitives live in the mesh folder
+	std::string getMeshPath(const MeshKey& key) const
+	{
+		return key.type == "file" ? key.path : directory + "/" + getMeshFileName(key);
+	}
+
+	// CPU copy of one mesh: from its baked file if there is a valid one, generated otherwise.
+	// Touches nothing but mesh and messages, which gets the lines to print, so jobs can run it
+	// in parallel.
+	void loadMeshData(const MeshKey& key, MeshData& mesh, std::string& messages) const
+	{
+		std::string path = getMeshPath(key);
+		MappedFile file;
+		if (file.open(path.c_str()))
+		{
+			const MeshFileHeader* header = validateMeshFile(file.getData(), file.getSize());
+			if (header)
+			{
+				readMeshFile(header, mesh);
+				return;
+			}
+			messages += "Mesh file " + path + " is not a valid version " + std::to_string(MESH_VERSION) + " mesh, regenerating\n";
+		}
+
+		if (!generateMeshData(key, mesh))
+		{
+			messages += "Mesh failed to load: " + path + ", using a plane\n";
+			mesh = buildPlaneMesh();
+		}
+		// baked files were optimized by mesh_converter already
+		optimizeMesh(mesh);
+	}
+};
+
+#endif
@@ -0,0 +1,192 @@
+// Mesh converter: writes meshes to the binary .mesh format (mesh_format.h) so the renderer can
+// memory map them instead of generating or parsing geometry at startup.
+//
+// Usage:
+//   mesh_converter <scene file> [output folder]   bake every generated primitive the scene uses,
+//                                                 with all its levels of detail
+//                                                 (default folder: meshes, as MeshCache expects)
+//   mesh_converter --obj <model.obj> <out.mesh>   convert a Wavefront OBJ model, reference it
+//                                                 from a scene with "mesh <name> file <out.mesh>"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "mesh_data.h"
+#include "mesh_format.h"
+#include "mesh_optimizer.h"
+#include "scene.h"
+
+// OBJ indices are 1 based and may be negative (relative to the end of the list so far)
+static int resolveObjIndex(const std::string& text, size_t count)
+{
+	if (text.empty())
+		return -1;
+	int index = std::atoi(text.c_str());
+	if (index < 0)
+		return (int)count + index;
+	return index - 1;
+}
+
+// Load positions, texture coordinates and normals from an OBJ file. Polygons are split into
+// triangle fans and identical position/texcoord/normal combinations share one vertex.
+static bool loadObj(const char* path, MeshData& mesh)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "Model failed to load at path: " << path << std::endl;
+		return false;
+	}
+
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::map<std::tuple<int, int, int>, uint32_t> vertexLookup;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream in(line);
+		std::string keyword;
+		if (!(in >> keyword))
+			continue;
+
+		if (keyword == "v")
+		{
+			glm::vec3 p;
+			in >> p.x >> p.y >> p.z;
+			positions.push_back(p);
+		}
+		else if (keyword == "vt")
+		{
+			glm::vec2 t;
+			in >> t.x >> t.y;
+			texCoords.push_back(t);
+		}
+		else if (keyword == "vn")
+		{
+			glm::vec3 n;
+			in >> n.x >> n.y >> n.z;
+			normals.push_back(n);
+		}
+		else if (keyword == "f")
+		{
+			std::vector<uint32_t> polygon;
+			std::string corner;
+			while (in >> corner)
+			{
+				// v, v/vt, v//vn or v/vt/vn
+				std::string parts[3];
+				int part = 0;
+				for (char c : corner)
+				{
+					if (c == '/')
+						part = std::min(part + 1, 2);
+					else
+						parts[part] += c;
+				}
+				int v = resolveObjIndex(parts[0], positions.size());
+				int vt = resolveObjIndex(parts[1], texCoords.size());
+				int vn = resolveObjIndex(parts[2], normals.size());
+				if (v < 0 || v >= (int)positions.size())
+				{
+					std::cout << path << ": bad face \"" << line << "\"" << std::endl;
+					return false;
+				}
+
+				std::tuple<int, int, int> key(v, vt, vn);
+				auto found = vertexLookup.find(key);
+				if (found == vertexLookup.end())
+				{
+					glm::vec3 normal = vn >= 0 && vn < (int)normals.size() ? normals[vn] : glm::vec3(0.0f, 1.0f, 0.0f);
+					glm::vec2 texCoord = vt >= 0 && vt < (int)texCoords.size() ? texCoords[vt] : glm::vec2(0.0f, 0.0f);
+					found = vertexLookup.insert(std::make_pair(key, mesh.addVertex(positions[v], normal, texCoord.x, texCoord.y))).first;
+				}
+				polygon.push_back(found->second);
+			}
+
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+				mesh.addTriangle(polygon[0], polygon[i], polygon[i + 1]);
+		}
+	}
+
+	mesh.computeBounds();
+	return !mesh.indices.empty();
+}
+
+// Optimize and write a mesh, reporting the vertex cache efficiency before and after
+static bool writeMesh(const std::string& path, MeshData& mesh)
+{
+	size_t vertexCount = mesh.getVertexCount();
+	VertexCacheStats before = analyzeVertexCache(mesh.indices, vertexCount);
+	optimizeMesh(mesh);
+	VertexCacheStats after = analyzeVertexCache(mesh.indices, mesh.getVertexCount());
+
+	if (!writeMeshFile(path.c_str(), mesh))
+	{
+		std::cout << "Failed to write " << path << std::endl;
+		return false;
+	}
+	char report[160];
+	snprintf(report, sizeof(report), "%zu -> %zu vertices, %zu triangles, %d bit indices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+		vertexCount, mesh.getVertexCount(), mesh.indices.size() / 3, mesh.fitsShortIndices() ? 16 : 32,
+		before.acmr, after.acmr, before.atvr, after.atvr);
+	std::cout << path << ": " << report << std::endl;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 4 && std::string(argv[1]) == "--obj")
+	{
+		MeshData mesh;
+		if (!loadObj(argv[2], mesh))
+			return 1;
+		return writeMesh(argv[3], mesh) ? 0 : 1;
+	}
+
+	if (argc < 2)
+	{
+		std::cout << "Usage: mesh_converter <scene file> [output folder]" << std::endl;
+		std::cout << "       mesh_converter --obj <model.obj> <out.mesh>" << std::endl;
+		return 1;
+	}
+
+	Scene scene;
+	if (!scene.load(argv[1]))
+		return 1;
+	std::string directory = argc > 2 ? argv[2] : "meshes";
+
+	// every distinct generated primitive and its levels of detail once, imported files are already baked
+	std::set<MeshKey> baked;
+	int failures = 0;
+	for (const MeshDesc& desc : scene.meshes)
+	{
+		MeshKey lodKeys[MAX_MESH_LODS];
+		int lodCount = getLodKeys(makeMeshKey(desc), lodKeys);
+		for (int level = 0; level < lodCount; level++)
+		{
+			const MeshKey& key = lodKeys[level];
+			if (key.type == "file" || !baked.insert(key).second)
+				continue;
+
+			MeshData mesh;
+			if (!generateMeshData(key, mesh))
+			{
+				std::cout << "Unknown mesh type " << key.type << " for mesh " << desc.name << std::endl;
+				failures++;
+				continue;
+			}
+			if (!writeMesh(directory + "/" + getMeshFileName(key), mesh))
+				failures++;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
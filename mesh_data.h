@@ -0,0 +1,351 @@
+#ifndef MESH_DATA_H
+#define MESH_DATA_H
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+// Every mesh uses the same interleaved vertex: position (3), normal (3), texture coordinate (2)
+const int MESH_VERTEX_FLOATS = 8;
+
+// Parametric primitives are generated as a chain of levels of detail, each level with this
+// fraction of the full tessellation but never less than the minimum below
+const int MAX_MESH_LODS = 3;
+const float LOD_TESSELLATION_SCALE[MAX_MESH_LODS] = { 1.0f, 0.5f, 0.25f };
+const int LOD_MIN_SPHERE_SECTORS = 8;
+const int LOD_MIN_SPHERE_STACKS = 6;
+const int LOD_MIN_CYLINDER_SLICES = 16;
+
+// One level of detail, a range of the mesh's index buffer
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// CPU side copy of a mesh as an indexed triangle list, what both the generators below and
+// the binary .mesh files (mesh_format.h) produce
+struct MeshData
+{
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	uint32_t addVertex(const glm::vec3& position, const glm::vec3& normal, float s, float t)
+	{
+		uint32_t index = (uint32_t)getVertexCount();
+		const float vertex[MESH_VERTEX_FLOATS] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, s, t };
+		vertices.insert(vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+		return index;
+	}
+
+	void addTriangle(uint32_t a, uint32_t b, uint32_t c)
+	{
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	size_t getVertexCount() const { return vertices.size() / MESH_VERTEX_FLOATS; }
+
+	// 16 bit indices halve the index buffer, every primitive we generate fits
+	bool fitsShortIndices() const { return getVertexCount() <= 65536; }
+
+	std::vector<uint16_t> getShortIndices() const
+	{
+		return std::vector<uint16_t>(indices.begin(), indices.end());
+	}
+
+	// Add another mesh after this one, its indices are moved past the vertices already here
+	void append(const MeshData& other)
+	{
+		uint32_t base = (uint32_t)getVertexCount();
+		vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+		for (uint32_t index : other.indices)
+			indices.push_back(base + index);
+	}
+
+	glm::vec3 getPosition(size_t vertex) const
+	{
+		const float* v = &vertices[vertex * MESH_VERTEX_FLOATS];
+		return glm::vec3(v[0], v[1], v[2]);
+	}
+
+	void computeBounds()
+	{
+		if (vertices.empty())
+			return;
+		boundsMin = boundsMax = getPosition(0);
+		for (size_t i = 1; i < getVertexCount(); i++)
+		{
+			boundsMin = glm::min(boundsMin, getPosition(i));
+			boundsMax = glm::max(boundsMax, getPosition(i));
+		}
+	}
+};
+
+// Flat 1x1 square in the XZ plane, used for the table top and the lamps
+inline MeshData buildPlaneMesh()
+{
+	MeshData mesh;
+	glm::vec3 normal(0.0f, 0.0f, 1.0f);
+	mesh.addVertex(glm::vec3(-0.5f, 0.0f, -0.5f), normal, 0.0f, 1.0f);
+	mesh.addVertex(glm::vec3( 0.5f, 0.0f, -0.5f), normal, 1.0f, 1.0f);
+	mesh.addVertex(glm::vec3( 0.5f, 0.0f,  0.5f), normal, 1.0f, 0.0f);
+	mesh.addVertex(glm::vec3( 0.5f, 0.0f,  0.5f), normal, 1.0f, 0.0f);
+	mesh.addVertex(glm::vec3(-0.5f, 0.0f,  0.5f), normal, 0.0f, 0.0f);
+	mesh.addVertex(glm::vec3(-0.5f, 0.0f, -0.5f), normal, 0.0f, 1.0f);
+	mesh.addTriangle(0, 1, 2);
+	mesh.addTriangle(3, 4, 5);
+	mesh.computeBounds();
+	return mesh;
+}
+
+// Unit box spanning -1..1 in x and z and 0..1 in y, the same 36 vertices createCube used to build
+inline MeshData buildBoxMesh()
+{
+	const float verts[] = {
+		// positions          // normals           // texture coords
+		-1.0f, 0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
+		 1.0f, 0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
+		 1.0f, 1.0f, -1.0f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
+		 1.0f, 1.0f, -1.0f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
+		-1.0f, 1.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
+		-1.0f, 0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
+
+		-1.0f, 0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
+		 1.0f, 0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 0.0f,
+		 1.0f, 1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
+		 1.0f, 1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
+		-1.0f, 1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 1.0f,
+		-1.0f, 0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
+
+		-1.0f, 1.0f,  1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+		-1.0f, 1.0f, -1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
+		-1.0f, 0.0f, -1.0f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+		-1.0f, 0.0f, -1.0f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+		-1.0f, 0.0f,  1.0f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
+		-1.0f, 1.0f,  1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+
+		 1.0f, 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+		 1.0f, 1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
+		 1.0f, 0.0f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+		 1.0f, 0.0f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+		 1.0f, 0.0f,  1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
+		 1.0f, 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+
+		-1.0f, 0.0f, -1.0f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
+		 1.0f, 0.0f, -1.0f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
+		 1.0f, 0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
+		 1.0f, 0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
+		-1.0f, 0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
+		-1.0f, 0.0f, -1.0f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
+
+		-1.0f, 1.0f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
+		 1.0f, 1.0f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
+		 1.0f, 1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
+		 1.0f, 1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
+		-1.0f, 1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
+		-1.0f, 1.0f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f
+	};
+
+	MeshData mesh;
+	mesh.vertices.assign(verts, verts + sizeof(verts) / sizeof(float));
+	for (uint32_t i = 0; i < 36; i += 3)
+		mesh.addTriangle(i, i + 1, i + 2);
+	mesh.computeBounds();
+	return mesh;
+}
+
+// Unit sphere from stacks and sectors, slightly stretched in x and y into the scene's egg shape
+inline MeshData buildSphereMesh(int sectorCount, int stackCount)
+{
+	MeshData mesh;
+	float sectorStep = (float)(2 * M_PI / sectorCount);
+	float stackStep = (float)(M_PI / stackCount);
+
+	for (int i = 0; i <= stackCount; ++i)
+	{
+		float stackAngle = (float)(M_PI / 2 - i * stackStep);	// starting from pi/2 to -pi/2
+		float xy = 1.02f * cosf(stackAngle);
+		float z = sinf(stackAngle);
+
+		// the first and last vertices of a stack have same position and normal, but different tex coords
+		for (int j = 0; j <= sectorCount; ++j)
+		{
+			float sectorAngle = j * sectorStep;
+			glm::vec3 position(xy * cosf(sectorAngle), xy * sinf(sectorAngle), z);
+			glm::vec3 normal(cosf(stackAngle) * cosf(sectorAngle), cosf(stackAngle) * sinf(sectorAngle), z);
+			mesh.addVertex(position, normal, (float)j / sectorCount, (float)i / stackCount);
+		}
+	}
+
+	for (int i = 0; i < stackCount; ++i)
+	{
+		uint32_t k1 = i * (sectorCount + 1);	// beginning of current stack
+		uint32_t k2 = k1 + sectorCount + 1;		// beginning of next stack
+
+		for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
+		{
+			// 2 triangles per sector excluding first and last stacks
+			if (i != 0)
+				mesh.addTriangle(k1, k2, k1 + 1);
+			if (i != (stackCount - 1))
+				mesh.addTriangle(k1 + 1, k2, k2 + 1);
+		}
+	}
+	mesh.computeBounds();
+	return mesh;
+}
+
+// Open topped unit cylinder (radius 1, height 1, centered on the origin), the scene's bowl:
+// the side strip and the bottom fan, as one triangle list
+inline MeshData buildCylinderMesh(int numSlices)
+{
+	MeshData mesh;
+	const float halfHeight = 0.5f;
+	const float sliceAngleStep = 2.0f * (float)M_PI / float(numSlices);
+	// the texture is mapped twice around the cylinder
+	const float sliceTextureStepU = 2.0f / float(numSlices);
+
+	// side: a top and a bottom vertex per slice
+	for (int i = 0; i <= numSlices; i++)
+	{
+		float c = cosf(i * sliceAngleStep), s = sinf(i * sliceAngleStep);
+		glm::vec3 normal(c, 0.0f, s);
+		mesh.addVertex(glm::vec3(c, halfHeight, s), normal, i * sliceTextureStepU, 1.0f);
+		mesh.addVertex(glm::vec3(c, -halfHeight, s), normal, i * sliceTextureStepU, 0.0f);
+	}
+	uint32_t numVerticesSide = (uint32_t)mesh.getVertexCount();
+	for (uint32_t i = 0; i + 2 < numVerticesSide; i++)
+	{
+		// keep the strip's alternating winding
+		if (i % 2 == 0)
+			mesh.addTriangle(i, i + 1, i + 2);
+		else
+			mesh.addTriangle(i + 1, i, i + 2);
+	}
+
+	// bottom cover as a fan around its center
+	glm::vec3 down(0.0f, -1.0f, 0.0f);
+	uint32_t center = mesh.addVertex(glm::vec3(0.0f, -halfHeight, 0.0f), down, 1.0f, 0.0f);
+	for (int i = 0; i <= numSlices; i++)
+	{
+		float c = cosf(i * sliceAngleStep), s = sinf(i * sliceAngleStep);
+		mesh.addVertex(glm::vec3(c, -halfHeight, -s), down, 1.0f + s * 0.5f, 0.0f - c * 0.5f);
+	}
+	for (int i = 0; i < numSlices; i++)
+		mesh.addTriangle(center, center + 1 + i, center + 2 + i);
+
+	mesh.computeBounds();
+	return mesh;
+}
+
+// Identifies a piece of geometry by what it takes to generate it. Size is not part of the key,
+// every primitive is built at unit size and scaled by the node transform instead.
+struct MeshKey
+{
+	std::string type;		// plane, box, sphere, cylinder or file
+	int tessellation[2];	// sphere: sectors, stacks - cylinder: slices - unused otherwise
+	std::string path;		// file: the .mesh file to load
+
+	bool operator<(const MeshKey& other) const
+	{
+		if (type != other.type)
+			return type < other.type;
+		if (tessellation[0] != other.tessellation[0])
+			return tessellation[0] < other.tessellation[0];
+		if (tessellation[1] != other.tessellation[1])
+			return tessellation[1] < other.tessellation[1];
+		return path < other.path;
+	}
+};
+
+inline MeshKey makeMeshKey(const MeshDesc& desc)
+{
+	MeshKey key;
+	key.type = desc.type;
+	key.tessellation[0] = 0;
+	key.tessellation[1] = 0;
+	key.path = desc.path;
+	if (desc.type == "sphere")
+	{
+		key.tessellation[0] = (int)desc.params[0];
+		key.tessellation[1] = (int)desc.params[1];
+	}
+	else if (desc.type == "cylinder")
+	{
+		key.tessellation[0] = (int)desc.params[0];
+	}
+	return key;
+}
+
+// File name a generated primitive is baked to, e.g. sphere_30x30.mesh
+inline std::string getMeshFileName(const MeshKey& key)
+{
+	if (key.type == "file")
+		return key.path;
+	if (key.type == "sphere")
+		return "sphere_" + std::to_string(key.tessellation[0]) + "x" + std::to_string(key.tessellation[1]) + ".mesh";
+	if (key.type == "cylinder")
+		return "cylinder_" + std::to_string(key.tessellation[0]) + ".mesh";
+	return key.type + ".mesh";
+}
+
+// Run the generator for a primitive, returns false for keys that cannot be generated
+inline bool generateMeshData(const MeshKey& key, MeshData& mesh)
+{
+	if (key.type == "plane")
+		mesh = buildPlaneMesh();
+	else if (key.type == "box")
+		mesh = buildBoxMesh();
+	else if (key.type == "sphere")
+		mesh = buildSphereMesh(key.tessellation[0], key.tessellation[1]);
+	else if (key.type == "cylinder")
+		mesh = buildCylinderMesh(key.tessellation[0]);
+	else
+		return false;
+	return true;
+}
+
+// Keys of every level of detail of a primitive, finest first; returns how many there are.
+// Only spheres and cylinders have more than the one level. Levels whose tessellation would not
+// drop below the previous one are left out.
+inline int getLodKeys(const MeshKey& key, MeshKey lodKeys[MAX_MESH_LODS])
+{
+	lodKeys[0] = key;
+	if (key.type != "sphere" && key.type != "cylinder")
+		return 1;
+
+	int count = 1;
+	for (int level = 1; level < MAX_MESH_LODS; level++)
+	{
+		MeshKey lodKey = key;
+		if (key.type == "sphere")
+		{
+			lodKey.tessellation[0] = std::max(LOD_MIN_SPHERE_SECTORS, (int)std::lround(key.tessellation[0] * LOD_TESSELLATION_SCALE[level]));
+			lodKey.tessellation[1] = std::max(LOD_MIN_SPHERE_STACKS, (int)std::lround(key.tessellation[1] * LOD_TESSELLATION_SCALE[level]));
+		}
+		else
+		{
+			lodKey.tessellation[0] = std::max(LOD_MIN_CYLINDER_SLICES, (int)std::lround(key.tessellation[0] * LOD_TESSELLATION_SCALE[level]));
+		}
+		const MeshKey& previous = lodKeys[count - 1];
+		if (lodKey.tessellation[0] >= previous.tessellation[0] && lodKey.tessellation[1] >= previous.tessellation[1])
+			break;
+		lodKeys[count++] = lodKey;
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mesh_data.h"
+
+// Binary mesh file (.mesh) written by mesh_converter.cpp: a fixed header followed by the
+// interleaved vertex array and the index array, each starting on a 64 byte boundary. It is read
+// through a memory mapping, which only saves the read into a buffer; readMeshFile() still copies
+// the arrays into a MeshData (widening 16 bit indices) and MeshPool packs them on add().
+// Files can come from users (scene "mesh <name> file <path>" entries), so validateMeshFile()
+// checks everything readMeshFile() and the pool rely on.
+
+const char MESH_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+// 2: geometry is deduplicated and cache optimized, files from version 1 get regenerated
+const uint32_t MESH_VERSION = 2;
+const uint32_t MESH_DATA_ALIGNMENT = 64;
+
+// Vertex formats
+const uint32_t MESH_VERTEX_FORMAT_FLOAT = 0;	// MESH_VERTEX_FLOATS floats per vertex
+
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexFormat;
+	uint32_t vertexStride;	// bytes per vertex
+	uint32_t vertexCount;
+	uint32_t indexSize;		// bytes per index, 2 or 4
+	uint32_t indexCount;
+	uint32_t reserved;
+	uint64_t vertexOffset;	// from the start of the file
+	uint64_t indexOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	float padding[2];
+};
+
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader layout changed, bump MESH_VERSION");
+
+inline uint64_t alignMeshOffset(uint64_t offset)
+{
+	return (offset + MESH_DATA_ALIGNMENT - 1) & ~(uint64_t)(MESH_DATA_ALIGNMENT - 1);
+}
+
+// Check a mapped file really is a mesh this build understands, returns its header or NULL
+inline const MeshFileHeader* validateMeshFile(const void* data, size_t size)
+{
+	if (!data || size < sizeof(MeshFileHeader))
+		return NULL;
+
+	const MeshFileHeader* header = (const MeshFileHeader*)data;
+	if (std::memcmp(header->magic, MESH_MAGIC, 4) != 0 || header->version != MESH_VERSION)
+		return NULL;
+	if (header->vertexFormat != MESH_VERTEX_FORMAT_FLOAT || header->vertexStride != MESH_VERTEX_FLOATS * sizeof(float))
+		return NULL;
+	if (header->indexSize != 2 && header->indexSize != 4)
+		return NULL;
+	if (header->indexCount % 3 != 0)
+		return NULL;
+
+	// the arrays sit after the header and are read as floats and 16 or 32 bit integers, the
+	// mapping itself is page aligned. Sizes are compared as what is left after the offset, so
+	// a huge offset cannot wrap around.
+	if (header->vertexOffset < sizeof(MeshFileHeader) || header->vertexOffset % 4 != 0 || header->vertexOffset > size)
+		return NULL;
+	if (header->indexOffset < sizeof(MeshFileHeader) || header->indexOffset % 4 != 0 || header->indexOffset > size)
+		return NULL;
+	if ((uint64_t)header->vertexCount * header->vertexStride > size - header->vertexOffset)
+		return NULL;
+	if ((uint64_t)header->indexCount * header->indexSize > size - header->indexOffset)
+		return NULL;
+
+	// an index past the mesh's vertices would read another mesh in the pool, or past the buffer
+	const unsigned char* indices = (const unsigned char*)data + header->indexOffset;
+	for (uint32_t i = 0; i < header->indexCount; i++)
+	{
+		uint32_t index = header->indexSize == 2 ? ((const uint16_t*)indices)[i] : ((const uint32_t*)indices)[i];
+		if (index >= header->vertexCount)
+			return NULL;
+	}
+	return header;
+}
+
+// Copy a validated mesh file into a MeshData, 16 bit indices are widened
+inline void readMeshFile(const MeshFileHeader* header, MeshData& mesh)
+{
+	const unsigned char* base = (const unsigned char*)header;
+	const float* vertices = (const float*)(base + header->vertexOffset);
+	mesh.vertices.assign(vertices, vertices + (size_t)header->vertexCount * MESH_VERTEX_FLOATS);
+	mesh.indices.resize(header->indexCount);
+	for (uint32_t i = 0; i < header->indexCount; i++)
+	{
+		if (header->indexSize == 2)
+			mesh.indices[i] = ((const uint16_t*)(base + header->indexOffset))[i];
+		else
+			mesh.indices[i] = ((const uint32_t*)(base + header->indexOffset))[i];
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		mesh.boundsMin[i] = header->boundsMin[i];
+		mesh.boundsMax[i] = header->boundsMax[i];
+	}
+}
+
+inline bool writeMeshFile(const char* path, const MeshData& mesh)
+{
+	MeshFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MESH_MAGIC, 4);
+	header.version = MESH_VERSION;
+	header.vertexFormat = MESH_VERTEX_FORMAT_FLOAT;
+	header.vertexStride = MESH_VERTEX_FLOATS * sizeof(float);
+	header.vertexCount = (uint32_t)mesh.getVertexCount();
+	bool shortIndices = mesh.fitsShortIndices();
+	header.indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.vertexOffset = alignMeshOffset(sizeof(MeshFileHeader));
+	header.indexOffset = alignMeshOffset(header.vertexOffset + (uint64_t)header.vertexCount * header.vertexStride);
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	const unsigned char zeros[MESH_DATA_ALIGNMENT] = { 0 };
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(zeros, 1, (size_t)(header.vertexOffset - sizeof(header)), file);
+	fwrite(mesh.vertices.data(), sizeof(float), mesh.vertices.size(), file);
+	fwrite(zeros, 1, (size_t)(header.indexOffset - header.vertexOffset - (uint64_t)header.vertexCount * header.vertexStride), file);
+	if (shortIndices)
+		fwrite(mesh.getShortIndices().data(), sizeof(uint16_t), mesh.indices.size(), file);
+	else
+		fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file);
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+// Read only memory mapping of a whole file, unmapped when the object goes away
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	bool open(const char* path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+		{
+			close();
+			return false;
+		}
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)fileSize.QuadPart;
+#else
+		descriptor = ::open(path, O_RDONLY);
+		if (descriptor < 0)
+			return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+		{
+			close();
+			return false;
+		}
+		size = (size_t)info.st_size;
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+#endif
+		if (!data)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap(data, size);
+		if (descriptor >= 0)
+			::close(descriptor);
+		descriptor = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	const void* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	void* data = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int descriptor = -1;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#endif
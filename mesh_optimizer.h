@@ -0,0 +1,206 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_data.h"
+
+// Size of the post transform cache modelled by the Forsyth reordering (LRU)
+const int VERTEX_CACHE_SIZE = 32;
+// and by analyzeVertexCache (FIFO, the small cache of older hardware is the conservative guess)
+const int VERTEX_CACHE_ANALYSIS_SIZE = 16;
+
+// Average cache miss ratio (vertex shader runs per triangle, 0.5 is the best a regular grid
+// can do) and average transform to vertex ratio (runs per unique vertex, 1.0 is ideal)
+struct VertexCacheStats
+{
+	float acmr;
+	float atvr;
+};
+
+// Replay the index buffer through a FIFO cache and count the misses
+inline VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = VERTEX_CACHE_ANALYSIS_SIZE)
+{
+	std::vector<uint32_t> cache;
+	size_t misses = 0;
+	for (uint32_t index : indices)
+	{
+		if (std::find(cache.begin(), cache.end(), index) != cache.end())
+			continue;
+		misses++;
+		cache.push_back(index);
+		if ((int)cache.size() > cacheSize)
+			cache.erase(cache.begin());
+	}
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+	stats.atvr = vertexCount == 0 ? 0.0f : (float)misses / vertexCount;
+	return stats;
+}
+
+// Merge vertices with identical position, normal and texture coordinate (the generators write
+// shared corners once per triangle in places)
+inline void deduplicateVertices(MeshData& mesh)
+{
+	const size_t vertexSize = MESH_VERTEX_FLOATS * sizeof(float);
+	std::unordered_map<std::string, uint32_t> lookup;
+	std::vector<uint32_t> remap(mesh.getVertexCount());
+	std::vector<float> vertices;
+	for (size_t i = 0; i < mesh.getVertexCount(); i++)
+	{
+		const float* vertex = &mesh.vertices[i * MESH_VERTEX_FLOATS];
+		std::string key((const char*)vertex, vertexSize);
+		auto found = lookup.find(key);
+		if (found == lookup.end())
+		{
+			found = lookup.insert(std::make_pair(key, (uint32_t)(vertices.size() / MESH_VERTEX_FLOATS))).first;
+			vertices.insert(vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+		}
+		remap[i] = found->second;
+	}
+	for (uint32_t& index : mesh.indices)
+		index = remap[index];
+	mesh.vertices.swap(vertices);
+}
+
+// Forsyth's linear speed vertex cache optimisation: triangles are emitted greedily, always the
+// one whose vertices score highest. Vertices score for being recently used (in the modelled
+// LRU cache) and for having few triangles left, so fans get finished instead of left behind.
+inline void optimizeVertexCache(MeshData& mesh)
+{
+	const size_t vertexCount = mesh.getVertexCount();
+	const size_t triangleCount = mesh.indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// triangles using each vertex
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : mesh.indices)
+		adjacencyOffsets[index + 1]++;
+	for (size_t i = 0; i < vertexCount; i++)
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+	std::vector<uint32_t> adjacency(mesh.indices.size());
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+		adjacency[fill[mesh.indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<int> valence(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		valence[i] = (int)(adjacencyOffsets[i + 1] - adjacencyOffsets[i]);
+
+	auto scoreVertex = [](int position, int remaining) {
+		if (remaining == 0)
+			return -1.0f;
+		float score = 0.0f;
+		if (position >= 0)
+		{
+			// the last triangle's three vertices score the same, so its winding is not favoured
+			if (position < 3)
+				score = 0.75f;
+			else
+				score = std::pow(1.0f - (float)(position - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / std::sqrt((float)remaining);
+	};
+
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		vertexScores[i] = scoreVertex(-1, valence[i]);
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScores[t] = vertexScores[mesh.indices[t * 3]] + vertexScores[mesh.indices[t * 3 + 1]] + vertexScores[mesh.indices[t * 3 + 2]];
+
+	std::vector<unsigned char> emitted(triangleCount, 0);
+	std::vector<uint32_t> result;
+	result.reserve(mesh.indices.size());
+	std::vector<uint32_t> cache, newCache;
+	size_t scan = 0;
+	int best = -1;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (best < 0)
+		{
+			// nothing in the cache connects to a triangle left, take the next one in order
+			while (emitted[scan])
+				scan++;
+			best = (int)scan;
+		}
+
+		const uint32_t* triangle = &mesh.indices[best * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[best] = 1;
+
+		// the triangle's vertices move to the front of the LRU cache
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t vertex : cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+				newCache.push_back(vertex);
+		}
+		for (int i = 0; i < 3; i++)
+			valence[triangle[i]]--;
+		for (size_t i = VERTEX_CACHE_SIZE; i < newCache.size(); i++)
+			vertexScores[newCache[i]] = scoreVertex(-1, valence[newCache[i]]);
+		if (newCache.size() > (size_t)VERTEX_CACHE_SIZE)
+			newCache.resize(VERTEX_CACHE_SIZE);
+		cache.swap(newCache);
+
+		// rescore what is in the cache and pick the best triangle touching it
+		for (size_t i = 0; i < cache.size(); i++)
+			vertexScores[cache[i]] = scoreVertex((int)i, valence[cache[i]]);
+		best = -1;
+		float bestScore = -1.0f;
+		for (uint32_t vertex : cache)
+		{
+			for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+			{
+				uint32_t t = adjacency[a];
+				if (emitted[t])
+					continue;
+				const uint32_t* other = &mesh.indices[t * 3];
+				triangleScores[t] = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					best = (int)t;
+				}
+			}
+		}
+	}
+	mesh.indices.swap(result);
+}
+
+// Renumber the vertices in the order the index buffer first uses them, so vertex fetches walk
+// memory forwards. Unreferenced vertices are dropped.
+inline void optimizeVertexFetch(MeshData& mesh)
+{
+	std::vector<uint32_t> remap(mesh.getVertexCount(), UINT32_MAX);
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = (uint32_t)(vertices.size() / MESH_VERTEX_FLOATS);
+			const float* vertex = &mesh.vertices[index * MESH_VERTEX_FLOATS];
+			vertices.insert(vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(vertices);
+}
+
+// Everything above in order, what every generated primitive goes through
+inline void optimizeMesh(MeshData& mesh)
+{
+	deduplicateVertices(mesh);
+	optimizeVertexCache(mesh);
+	optimizeVertexFetch(mesh);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bounds.h"
+#include "mesh_data.h"
+#include "meshes.h"
+#include "vertex_format.h"
+
+// A mesh living in a MeshPool's shared buffers: its vertices start at baseVertex and every level
+// of detail is a range of the shared index buffer. Indices are relative to baseVertex, so 16 bit
+// indices work for every mesh however big the pool gets. Packed vertices are quantized to the
+// mesh's own bounds.
+class PooledMesh : public Drawable
+{
+public:
+	PooledMesh(GLint baseVertex, const std::vector<MeshLod>& lods, const BoundingBox& box, const BoundingSphere& sphere,
+		const glm::vec3& positionScale, const glm::vec3& positionOffset)
+		: baseVertex(baseVertex), lods(lods), boundingBox(box), boundingSphere(sphere),
+		positionScale(positionScale), positionOffset(positionOffset) {}
+
+	int getLodCount() const override { return (int)lods.size(); }
+	GLsizei getIndexCount(int lod) const override { return (GLsizei)lods[lod].indexCount; }
+	GLuint getFirstIndex(int lod) const override { return lods[lod].firstIndex; }
+	GLint getBaseVertex() const override { return baseVertex; }
+	const BoundingBox& getBoundingBox() const override { return boundingBox; }
+	const BoundingSphere& getBoundingSphere() const override { return boundingSphere; }
+	const glm::vec3& getPositionScale() const override { return positionScale; }
+	const glm::vec3& getPositionOffset() const override { return positionOffset; }
+
+private:
+	GLint baseVertex;
+	std::vector<MeshLod> lods;
+	BoundingBox boundingBox;
+	BoundingSphere boundingSphere;
+	glm::vec3 positionScale;
+	glm::vec3 positionOffset;
+};
+
+// One vertex buffer, one index buffer and one VAO holding every mesh of the scene, so the whole
+// scene can be drawn without switching VAOs (and with one glMultiDrawElementsIndirect per
+// pass, see multi_draw.h). Meshes are collected on the CPU with add() and go to the GPU in
+// one go with upload(). The CPU copies stay, so meshes can still be added afterwards; they
+// can be drawn once upload() has run again. Every mesh is quantized to its own bounds and its
+// position decode travels with the instance data, so a large mesh costs the others no precision.
+class MeshPool
+{
+public:
+	MeshPool(Vertex_Format format = VERTEX_FORMAT_FLOAT) : format(format) {}
+
+	~MeshPool()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	// lods split mesh.indices into levels, one level covering everything if empty
+	std::shared_ptr<PooledMesh> add(const MeshData& mesh, std::vector<MeshLod> lods)
+	{
+		if (lods.empty())
+		{
+			MeshLod lod = { 0, (uint32_t)mesh.indices.size() };
+			lods.push_back(lod);
+		}
+		for (MeshLod& lod : lods)
+			lod.firstIndex += (uint32_t)indices.size();
+
+		BoundingBox box;
+		BoundingSphere sphere;
+		computeMeshBounds(mesh.vertices.data(), mesh.getVertexCount(), box, sphere);
+
+		GLint baseVertex = (GLint)vertexCount;
+		glm::vec3 positionScale(1.0f), positionOffset(0.0f);
+		if (format == VERTEX_FORMAT_PACKED)
+		{
+			std::vector<PackedVertex> packed;
+			packVertices(mesh.vertices.data(), mesh.getVertexCount(), box.min, box.max, packed, positionScale, positionOffset);
+			packedVertices.insert(packedVertices.end(), packed.begin(), packed.end());
+		}
+		else
+		{
+			vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		}
+		vertexCount += mesh.getVertexCount();
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+		shortIndices = shortIndices && mesh.fitsShortIndices();
+		dirty = true;
+		return std::make_shared<PooledMesh>(baseVertex, lods, box, sphere, positionScale, positionOffset);
+	}
+
+	// Bring the GL buffers up to date with everything added so far
+	void upload()
+	{
+		if (!dirty)
+			return;
+		dirty = false;
+		if (VAO == 0)
+		{
+			glGenVertexArrays(1, &VAO);
+			glGenBuffers(1, &VBO);
+			glGenBuffers(1, &EBO);
+		}
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (format == VERTEX_FORMAT_PACKED)
+			glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		setVertexAttributes(format);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		if (shortIndices)
+		{
+			std::vector<uint16_t> narrow(indices.begin(), indices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(uint16_t), narrow.data(), GL_STATIC_DRAW);
+		}
+		else
+		{
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLuint getVAO() const { return VAO; }
+	GLenum getIndexType() const { return shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+	size_t getIndexSize() const { return shortIndices ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+private:
+	Vertex_Format format;
+	GLuint VAO = 0, VBO = 0, EBO = 0;
+	// the vertices in the format they are uploaded in, only one of the two is used
+	std::vector<float> vertices;
+	std::vector<PackedVertex> packedVertices;
+	size_t vertexCount = 0;
+	std::vector<uint32_t> indices;
+	bool shortIndices = true;
+	bool dirty = false;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef MESHES_H
+#define MESHES_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "bounds.h"
+#include "mesh_data.h"
+#include "vertex_format.h"
+
+// Box around every vertex and a sphere around the box center reaching the farthest vertex,
+// which is tighter than the sphere around the box corners
+inline void computeMeshBounds(const float* vertices, size_t vertexCount, BoundingBox& box, BoundingSphere& sphere)
+{
+	if (vertexCount == 0)
+		return;
+	box.min = box.max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+	for (size_t i = 1; i < vertexCount; i++)
+	{
+		const float* position = vertices + i * MESH_VERTEX_FLOATS;
+		box.min = glm::min(box.min, glm::vec3(position[0], position[1], position[2]));
+		box.max = glm::max(box.max, glm::vec3(position[0], position[1], position[2]));
+	}
+
+	sphere.center = box.getCenter();
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const float* position = vertices + i * MESH_VERTEX_FLOATS;
+		glm::vec3 offset = glm::vec3(position[0], position[1], position[2]) - sphere.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	sphere.radius = std::sqrt(radiusSquared);
+}
+
+// Point attributes 0-2 of the bound VAO at vertices of the given format in the bound
+// GL_ARRAY_BUFFER
+inline void setVertexAttributes(Vertex_Format format)
+{
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		const GLsizei stride = sizeof(PackedVertex);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, texCoord));
+	}
+	else
+	{
+		const GLsizei stride = MESH_VERTEX_FLOATS * sizeof(float);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+	}
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+// Common interface for every mesh the scene can draw. They all live in a MeshPool and are drawn
+// through its VAO by the multi-draw batcher (see multi_draw.h), so a mesh only describes where
+// its levels of detail are in the pool's buffers.
+class Drawable
+{
+public:
+	virtual ~Drawable() {}
+	// levels of detail, 0 is the finest
+	virtual int getLodCount() const = 0;
+	// indices drawn per instance of a level
+	virtual GLsizei getIndexCount(int lod) const = 0;
+	// where a level starts in the pool's index buffer and the value added to its indices,
+	// what an indirect draw command needs
+	virtual GLuint getFirstIndex(int lod) const = 0;
+	virtual GLint getBaseVertex() const = 0;
+	// position decode of the vertices, goes into the instance data (see instancing.h)
+	virtual const glm::vec3& getPositionScale() const = 0;
+	virtual const glm::vec3& getPositionOffset() const = 0;
+	// bounds in model space, for culling
+	virtual const BoundingBox& getBoundingBox() const = 0;
+	virtual const BoundingSphere& getBoundingSphere() const = 0;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef MULTI_DRAW_H
+#define MULTI_DRAW_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <memory>
+#include <vector>
+
+#include "instancing.h"
+#include "mesh_pool.h"
+#include "meshes.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "scene.h"
+
+// Layout glMultiDrawElementsIndirect reads from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Shader and material (0 for none) a scene pass draws with, as the caller numbers them
+struct PassState
+{
+	int shader;
+	int material;
+};
+
+// A run of commands needing the same pass, shader and material, submitted with one call
+struct DrawGroup
+{
+	Scene_Pass pass;
+	int shader;
+	int material;
+	size_t firstCommand;
+	size_t commandCount;
+	long long triangles;
+};
+
+// The commands and groups of a frame. Building them needs no GL, so it can happen on any thread.
+struct DrawList
+{
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawGroup> groups;
+};
+
+// Turns the visible instance batches into indirect draw commands, one per level of detail of
+// every batch, against the shared buffers of a MeshPool. With GL_ARB_multi_draw_indirect and
+// GL_ARB_base_instance every group is a single glMultiDrawElementsIndirect, however many meshes
+// it holds. GL 3.3 has no base instance, so there the instanced attributes are moved to each
+// command's instances and the commands are drawn one by one; still no VAO switches between them.
+class MultiDrawBatcher
+{
+public:
+	MultiDrawBatcher() : indirectBuffer(GL_DRAW_INDIRECT_BUFFER)
+	{
+		useIndirect = GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+	}
+
+	// Submit every level of detail in use of every batch to queue, keyed by the pass's state,
+	// the mesh and the view depth of the closest instance (eye and forward are the camera's)
+	static void queueBatches(RenderQueue& queue, const std::vector<InstanceBatch>& batches, const std::vector<InstanceData>& instances,
+		const PassState* passStates, const glm::vec3& eye, const glm::vec3& forward, float farPlane)
+	{
+		queue.clear();
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			const InstanceBatch& batch = batches[b];
+			const PassState& state = passStates[batch.pass];
+			size_t first = batch.first;
+			for (int level = 0; level < MAX_MESH_LODS; level++)
+			{
+				size_t count = batch.lodCounts[level];
+				float depth = FLT_MAX;
+				for (size_t i = first; i < first + count; i++)
+					depth = std::min(depth, glm::dot(glm::vec3(instances[i].model[3]) - eye, forward));
+				if (count > 0)
+					queue.submit(makeSortKey(batch.pass, state.shader, state.material, batch.mesh, quantizeSortDepth(depth, farPlane)),
+						(uint32_t)(b * MAX_MESH_LODS + level));
+				first += count;
+			}
+		}
+		queue.sort();
+	}
+
+	// One command per queue entry in queue order (sorted, see queueBatches()), consecutive
+	// entries with the same state form a group
+	static void buildDrawList(const RenderQueue& queue, const std::vector<InstanceBatch>& batches, const std::vector<std::shared_ptr<Drawable>>& meshes,
+		DrawList& list)
+	{
+		std::vector<DrawElementsIndirectCommand>& commands = list.commands;
+		std::vector<DrawGroup>& groups = list.groups;
+		commands.clear();
+		groups.clear();
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			uint64_t key = queue.getKey(i);
+			if (groups.empty() || getSortKeyState(key) != getSortKeyState(queue.getKey(i - 1)))
+			{
+				DrawGroup group = { (Scene_Pass)getSortKeyPass(key), getSortKeyShader(key), getSortKeyMaterial(key), commands.size(), 0, 0 };
+				groups.push_back(group);
+			}
+
+			const InstanceBatch& batch = batches[queue.getItem(i) / MAX_MESH_LODS];
+			int level = (int)(queue.getItem(i) % MAX_MESH_LODS);
+			const Drawable& mesh = *meshes[batch.mesh];
+			size_t first = batch.first;
+			for (int l = 0; l < level; l++)
+				first += batch.lodCounts[l];
+			GLuint count = (GLuint)batch.lodCounts[level];
+			DrawElementsIndirectCommand command = { (GLuint)mesh.getIndexCount(level), count, mesh.getFirstIndex(level), mesh.getBaseVertex(), (GLuint)first };
+			commands.push_back(command);
+			groups.back().commandCount++;
+			groups.back().triangles += (long long)count * mesh.getIndexCount(level) / 3;
+		}
+	}
+
+	// Make list the one draw() works from, its commands go to the indirect buffer
+	void upload(const DrawList& list)
+	{
+		commands = list.commands;
+		groups = list.groups;
+		if (useIndirect && !commands.empty())
+			indirectOffset = indirectBuffer.write(commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+	}
+
+	// Draw a group, returns the number of draw calls it took. The pool's VAO has to be bound and
+	// the instanced attributes pointed at the first instance (instanceBuffer.bind(0)).
+	int draw(const DrawGroup& group, const MeshPool& pool, const InstanceBuffer& instanceBuffer) const
+	{
+		if (useIndirect)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.getBuffer());
+			glMultiDrawElementsIndirect(GL_TRIANGLES, pool.getIndexType(),
+				(void*)(indirectOffset + group.firstCommand * sizeof(DrawElementsIndirectCommand)), (GLsizei)group.commandCount, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			return 1;
+		}
+
+		for (size_t i = group.firstCommand; i < group.firstCommand + group.commandCount; i++)
+		{
+			const DrawElementsIndirectCommand& command = commands[i];
+			instanceBuffer.bind(command.baseInstance);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, pool.getIndexType(),
+				(void*)(command.firstIndex * pool.getIndexSize()), (GLsizei)command.instanceCount, command.baseVertex);
+		}
+		return (int)group.commandCount;
+	}
+
+	// after the last draw of the frame, see RingBuffer::endFrame()
+	void endFrame()
+	{
+		indirectBuffer.endFrame();
+	}
+
+	const std::vector<DrawGroup>& getGroups() const { return groups; }
+	bool usesIndirect() const { return useIndirect; }
+
+private:
+	RingBuffer indirectBuffer;
+	size_t indirectOffset = 0;
+	bool useIndirect = false;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawGroup> groups;
+};
+
+#endif
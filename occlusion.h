@@ -0,0 +1,399 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bounds.h"
+#include "shader.h"
+
+// The CPU copy of the pyramid starts at the first level at most this wide
+const int HIZ_READBACK_WIDTH = 128;
+// Readbacks in flight, a new pyramid reaches the CPU this many builds later at the latest
+const int HIZ_PIXEL_BUFFERS = 3;
+// Boxes are tested on the level where they cover at most this many texels across
+const int HIZ_TEST_TEXELS = 4;
+// Boxes per job when a frame's instances are tested in parallel
+const size_t OCCLUSION_TEST_GRAIN = 256;
+
+// Hierarchical depth occlusion culling. build() copies the frame's depth buffer, reduces it on
+// the GPU to a mip pyramid where every texel holds the farthest depth below it, and reads a
+// coarse level back without stalling. The CPU finishes the pyramid from there, and the culling
+// of a later frame rejects boxes whose closest point is behind everything drawn where they
+// would be. Boxes are projected with the view projection the depth was drawn with, so the test
+// stays conservative for that frame; objects uncovered since then show up a frame or two late.
+class HiZBuffer
+{
+public:
+	HiZBuffer() : shader("shaderfiles/hiz_downsample.vs", "shaderfiles/hiz_downsample.fs")
+	{
+		// the fullscreen triangle comes from gl_VertexID, the VAO stays empty
+		glGenVertexArrays(1, &VAO);
+		glGenFramebuffers(1, &copyFBO);
+		glGenFramebuffers(1, &pyramidFBO);
+		slots.resize(HIZ_PIXEL_BUFFERS);
+		for (Slot& slot : slots)
+			glGenBuffers(1, &slot.pixelBuffer);
+	}
+
+	~HiZBuffer()
+	{
+		for (Slot& slot : slots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			glDeleteBuffers(1, &slot.pixelBuffer);
+		}
+		glDeleteFramebuffers(1, &copyFBO);
+		glDeleteFramebuffers(1, &pyramidFBO);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &pyramidTexture);
+		glDeleteVertexArrays(1, &VAO);
+	}
+
+	// Build the pyramid from the depth of the bound framebuffer, drawn with viewProjection, and
+	// queue the readback. Binds its own program and VAO; the framebuffer, viewport and depth test
+	// are restored. Returns false without doing anything when every readback is still in
+	// flight: the GPU is behind, and waiting for it would stall this thread. The pyramid held
+	// stays, call again with a later frame's depth.
+	bool build(const glm::mat4& viewProjection)
+	{
+		// the slot about to be reused has to be read first, or its pyramid is lost
+		Slot& slot = slots[nextSlot];
+		if (slot.fence)
+		{
+			if (collect(slot))
+				collectedInBuild = true;
+			if (slot.fence)
+				return false;
+		}
+
+		GLint viewport[4];
+		GLint framebuffer = 0;
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		if (viewport[2] != width || viewport[3] != height)
+			allocate(framebuffer, viewport[2], viewport[3]);
+		if (depthTexture == 0)
+			return false;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO);
+		glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + width, viewport[1] + height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		glDisable(GL_DEPTH_TEST);
+		shader.use();
+		glUniform1i(glGetUniformLocation(shader.ID, "source"), 0);
+		glBindVertexArray(VAO);
+		glActiveTexture(GL_TEXTURE0);
+		glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+		for (int level = 0; level < levelCount; level++)
+		{
+			// every level reads the one above it, only that one is visible to the sampler
+			if (level == 0)
+			{
+				glBindTexture(GL_TEXTURE_2D, depthTexture);
+			}
+			else
+			{
+				glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			}
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+			glViewport(0, 0, getLevelSize(width / 2, level), getLevelSize(height / 2, level));
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindVertexArray(0);
+
+		// queue the coarse level's readback
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, readbackLevel);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, readbackWidth, readbackHeight, GL_RED, GL_FLOAT, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.viewProjection = viewProjection;
+		slot.width = readbackWidth;
+		slot.height = readbackHeight;
+		slot.screenWidth = width;
+		slot.screenHeight = height;
+		// level 0 of the pyramid is already half size
+		slot.shift = readbackLevel + 1;
+		slot.build = ++builds;
+		nextSlot = (nextSlot + 1) % slots.size();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+		return true;
+	}
+
+	// Pick up readbacks the GPU has finished, returns true if the CPU pyramid changed
+	bool update()
+	{
+		// a readback picked up by build() to free its slot counts too
+		bool changed = collectedInBuild;
+		collectedInBuild = false;
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			Slot& slot = slots[(nextSlot + i) % slots.size()];
+			if (slot.fence && collect(slot))
+				changed = true;
+		}
+		return changed;
+	}
+
+	bool isReady() const { return !levels.empty(); }
+
+	// True if every point of box is behind the captured depth, false when unsure (no pyramid
+	// yet, the box reaches in front of the camera or off screen)
+	bool isOccluded(const BoundingBox& box) const
+	{
+		if (levels.empty())
+			return false;
+
+		glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+		float closest = FLT_MAX;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+			glm::vec4 clip = levelViewProjection * glm::vec4(point, 1.0f);
+			// crossing the near plane, its projection is meaningless
+			if (clip.w <= 0.0f || clip.z < -clip.w)
+				return false;
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			low = glm::min(low, glm::vec2(ndc.x, ndc.y));
+			high = glm::max(high, glm::vec2(ndc.x, ndc.y));
+			closest = std::min(closest, ndc.z * 0.5f + 0.5f);
+		}
+		if (low.x < -1.0f || low.y < -1.0f || high.x > 1.0f || high.y > 1.0f)
+			return false;
+
+		// pixel rectangle to texels of the first level, then down the pyramid until it is a few
+		// texels wide. Every level halves, so a shift finds the texel holding a pixel.
+		int level = 0;
+		int x0 = (int)((low.x * 0.5f + 0.5f) * levelScreenWidth) >> levelShift;
+		int y0 = (int)((low.y * 0.5f + 0.5f) * levelScreenHeight) >> levelShift;
+		int x1 = (int)((high.x * 0.5f + 0.5f) * levelScreenWidth) >> levelShift;
+		int y1 = (int)((high.y * 0.5f + 0.5f) * levelScreenHeight) >> levelShift;
+		while (level + 1 < (int)levels.size() && (x1 - x0 >= HIZ_TEST_TEXELS || y1 - y0 >= HIZ_TEST_TEXELS))
+		{
+			level++;
+			x0 >>= 1;
+			y0 >>= 1;
+			x1 >>= 1;
+			y1 >>= 1;
+		}
+		// odd sizes fold their last row and column into the texel before, so past the end is
+		// the last texel
+		int w = levelWidths[level], h = levelHeights[level];
+		x0 = std::min(x0, w - 1);
+		x1 = std::min(x1, w - 1);
+		y0 = std::min(y0, h - 1);
+		y1 = std::min(y1, h - 1);
+
+		const std::vector<float>& depths = levels[level];
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				if (closest <= depths[(size_t)y * w + x])
+					return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		GLuint pixelBuffer = 0;
+		GLsync fence = 0;
+		glm::mat4 viewProjection = glm::mat4(1.0f);
+		int width = 0, height = 0;
+		int screenWidth = 0, screenHeight = 0, shift = 0;
+		long long build = 0;
+	};
+
+	Shader shader;
+	GLuint VAO = 0, copyFBO = 0, pyramidFBO = 0;
+	GLuint depthTexture = 0, pyramidTexture = 0;
+	int width = 0, height = 0;
+	int levelCount = 0, readbackLevel = 0, readbackWidth = 0, readbackHeight = 0;
+	std::vector<Slot> slots;
+	size_t nextSlot = 0;
+	long long builds = 0, collectedBuild = 0;
+	bool collectedInBuild = false;
+
+	// CPU pyramid from the readback down to 1x1
+	std::vector<std::vector<float>> levels;
+	std::vector<int> levelWidths, levelHeights;
+	glm::mat4 levelViewProjection = glm::mat4(1.0f);
+	int levelScreenWidth = 0, levelScreenHeight = 0, levelShift = 0;
+
+	static int getLevelSize(int size, int level)
+	{
+		return std::max(size >> level, 1);
+	}
+
+	// Depth copy in the format of the framebuffer's depth (blits need them to match) and the
+	// R32F pyramid starting at half its size
+	void allocate(GLint framebuffer, int newWidth, int newHeight)
+	{
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &pyramidTexture);
+		depthTexture = pyramidTexture = 0;
+		width = newWidth;
+		height = newHeight;
+		if (width < 2 || height < 2)
+			return;
+
+		GLint depthBits = 0, stencilBits = 0, depthType = GL_UNSIGNED_NORMALIZED;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		GLenum attachment = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &depthType);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT,
+			GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+		GLenum format, type;
+		GLenum copyAttachment = stencilBits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		if (depthType == GL_FLOAT)
+		{
+			format = stencilBits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+			type = stencilBits > 0 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_FLOAT;
+		}
+		else if (stencilBits > 0)
+		{
+			format = GL_DEPTH24_STENCIL8;
+			type = GL_UNSIGNED_INT_24_8;
+		}
+		else
+		{
+			format = depthBits <= 16 ? GL_DEPTH_COMPONENT16 : (depthBits <= 24 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT32);
+			type = GL_UNSIGNED_INT;
+		}
+
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, stencilBits > 0 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, copyFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, copyAttachment, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Hi-Z depth copy framebuffer is not complete" << std::endl;
+
+		levelCount = 1;
+		while (((width / 2) | (height / 2)) >> levelCount)
+			levelCount++;
+		glGenTextures(1, &pyramidTexture);
+		glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+		for (int level = 0; level < levelCount; level++)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, getLevelSize(width / 2, level), getLevelSize(height / 2, level), 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		readbackLevel = 0;
+		while (readbackLevel + 1 < levelCount && getLevelSize(width / 2, readbackLevel) > HIZ_READBACK_WIDTH)
+			readbackLevel++;
+		readbackWidth = getLevelSize(width / 2, readbackLevel);
+		readbackHeight = getLevelSize(height / 2, readbackLevel);
+		for (Slot& slot : slots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			slot.fence = 0;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readbackWidth * readbackHeight * sizeof(float), NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		levels.clear();
+	}
+
+	// Copy a finished readback into the CPU pyramid, never waits: if the GPU is not done yet the
+	// fence is left set. Returns true if the pyramid changed; readbacks older than the pyramid
+	// already held are dropped.
+	bool collect(Slot& slot)
+	{
+		GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		if (slot.build < collectedBuild)
+			return false;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		const float* depths = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)slot.width * slot.height * sizeof(float), GL_MAP_READ_BIT);
+		if (depths)
+		{
+			levels.resize(1);
+			levelWidths.assign(1, slot.width);
+			levelHeights.assign(1, slot.height);
+			levels[0].assign(depths, depths + (size_t)slot.width * slot.height);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			buildLevels();
+			levelViewProjection = slot.viewProjection;
+			levelScreenWidth = slot.screenWidth;
+			levelScreenHeight = slot.screenHeight;
+			levelShift = slot.shift;
+			collectedBuild = slot.build;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return depths != NULL;
+	}
+
+	// The rest of the pyramid on the CPU, with the same reduction as hiz_downsample.fs
+	void buildLevels()
+	{
+		while (levelWidths.back() > 1 || levelHeights.back() > 1)
+		{
+			const std::vector<float>& source = levels.back();
+			int sourceWidth = levelWidths.back(), sourceHeight = levelHeights.back();
+			int w = std::max(sourceWidth / 2, 1), h = std::max(sourceHeight / 2, 1);
+			std::vector<float> target((size_t)w * h);
+			for (int y = 0; y < h; y++)
+			{
+				// the last texel of an odd row or column goes with the pair before it
+				int y1 = (y == h - 1) ? sourceHeight : std::min(2 * y + 2, sourceHeight);
+				for (int x = 0; x < w; x++)
+				{
+					int x1 = (x == w - 1) ? sourceWidth : std::min(2 * x + 2, sourceWidth);
+					float farthest = 0.0f;
+					for (int sy = 2 * y; sy < y1; sy++)
+					{
+						for (int sx = 2 * x; sx < x1; sx++)
+							farthest = std::max(farthest, source[(size_t)sy * sourceWidth + sx]);
+					}
+					target[(size_t)y * w + x] = farthest;
+				}
+			}
+			levels.push_back(target);
+			levelWidths.push_back(w);
+			levelHeights.push_back(h);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,457 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+// frames of statistics kept for the overlay, the summary and the trace export
+const int PROFILER_HISTORY = 240;
+// frames between issuing GPU timestamps and reading them back, so reading never stalls
+const int PROFILER_QUERY_LATENCY = 4;
+
+// One timed scope within a frame. Times are in milliseconds since the profiler was created,
+// GPU times are converted to the same clock. A GPU time below zero means not resolved (yet).
+struct ProfileSample
+{
+	int scope;
+	int depth;
+	double cpuStart;
+	double cpuTime;
+	double gpuStart;
+	double gpuTime;
+};
+
+struct ProfileFrame
+{
+	long long index = -1;
+	std::vector<ProfileSample> samples;	// samples[0] is the whole frame
+};
+
+// Frame profiler with nested CPU and GPU timers. Every scope records the CPU clock and a pair of
+// GL_TIMESTAMP queries (GL_TIME_ELAPSED queries cannot be nested). The query results are read
+// PROFILER_QUERY_LATENCY frames later, when the GPU is done with them. Finished frames go into a
+// ring buffer of PROFILER_HISTORY frames which can be averaged, drawn or exported as a Chrome trace.
+class Profiler
+{
+public:
+	Profiler()
+	{
+		epoch = std::chrono::steady_clock::now();
+		history.resize(PROFILER_HISTORY);
+		querySlots.resize(PROFILER_QUERY_LATENCY + 1);
+		frameScope = registerScope("frame");
+	}
+
+	~Profiler()
+	{
+		for (QuerySlot& slot : querySlots)
+		{
+			if (!slot.queries.empty())
+				glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+		}
+	}
+
+	// Timers only run while enabled, a disabled profiler costs a branch per scope.
+	// Takes effect from the next beginFrame().
+	void setEnabled(bool enable)
+	{
+		if (enable && !calibrated)
+		{
+			// line the GPU clock up with ours once, both are read as close together as we can
+			GLint64 gpuNow = 0;
+			glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+			gpuOffset = getCpuTime() - gpuNow / 1000000.0;
+			calibrated = true;
+		}
+		enabled = enable;
+	}
+	bool isEnabled() const { return enabled; }
+
+	// Names are registered once and referred to by id, so timing a scope never allocates
+	int registerScope(const std::string& name)
+	{
+		std::map<std::string, int>::iterator it = scopeIds.find(name);
+		if (it != scopeIds.end())
+			return it->second;
+		scopeNames.push_back(name);
+		scopeIds[name] = (int)scopeNames.size() - 1;
+		return (int)scopeNames.size() - 1;
+	}
+	const std::string& getScopeName(int scope) const { return scopeNames[scope]; }
+
+	void beginFrame()
+	{
+		if (!enabled)
+			return;
+
+		// the slot this frame will use was last used PROFILER_QUERY_LATENCY + 1 frames ago
+		QuerySlot& slot = querySlots[frameCount % querySlots.size()];
+		resolve(slot);
+		slot.frameIndex = frameCount;
+		slot.used = 0;
+
+		ProfileFrame& frame = history[frameCount % history.size()];
+		frame.index = frameCount;
+		frame.samples.clear();
+		openScopes.clear();
+		inFrame = true;
+		begin(frameScope);
+	}
+
+	void endFrame()
+	{
+		if (!inFrame)
+			return;
+		while (!openScopes.empty())
+			end();
+		inFrame = false;
+		frameCount++;
+	}
+
+	void begin(int scope)
+	{
+		if (!inFrame)
+			return;
+
+		ProfileFrame& frame = history[frameCount % history.size()];
+		ProfileSample sample;
+		sample.scope = scope;
+		sample.depth = (int)openScopes.size();
+		sample.cpuStart = getCpuTime();
+		sample.cpuTime = 0.0;
+		sample.gpuStart = -1.0;
+		sample.gpuTime = -1.0;
+		frame.samples.push_back(sample);
+		openScopes.push_back((int)frame.samples.size() - 1);
+
+		QuerySlot& slot = querySlots[frameCount % querySlots.size()];
+		slot.begins.push_back(slot.used);
+		slot.ends.push_back(-1);
+		glQueryCounter(getQuery(slot), GL_TIMESTAMP);
+	}
+
+	void end()
+	{
+		if (!inFrame || openScopes.empty())
+			return;
+
+		int index = openScopes.back();
+		openScopes.pop_back();
+		ProfileSample& sample = history[frameCount % history.size()].samples[index];
+		sample.cpuTime = getCpuTime() - sample.cpuStart;
+
+		QuerySlot& slot = querySlots[frameCount % querySlots.size()];
+		slot.ends[index] = slot.used;
+		glQueryCounter(getQuery(slot), GL_TIMESTAMP);
+	}
+
+	// Read back every frame still in flight, call before reporting at the end of a run
+	void flush()
+	{
+		for (size_t i = 0; i < querySlots.size(); i++)
+			resolve(querySlots[(frameCount + i) % querySlots.size()]);
+	}
+
+	// Most recent frame whose GPU times are known, NULL if there is none yet
+	const ProfileFrame* getLastResolvedFrame() const
+	{
+		if (lastResolved < 0)
+			return NULL;
+		return &history[lastResolved % history.size()];
+	}
+
+	// Resolved frames in the history, oldest first
+	std::vector<const ProfileFrame*> getResolvedFrames() const
+	{
+		std::vector<const ProfileFrame*> frames;
+		for (long long index = std::max(0LL, lastResolved - (long long)history.size() + 1); lastResolved >= 0 && index <= lastResolved; index++)
+		{
+			// frames recorded while the profiler was off are skipped
+			if (history[index % history.size()].index == index)
+				frames.push_back(&history[index % history.size()]);
+		}
+		return frames;
+	}
+
+	// Average CPU and GPU milliseconds per frame spent in each scope over the history
+	void getAverages(std::vector<double>& cpuTimes, std::vector<double>& gpuTimes) const
+	{
+		cpuTimes.assign(scopeNames.size(), 0.0);
+		gpuTimes.assign(scopeNames.size(), 0.0);
+		std::vector<const ProfileFrame*> frames = getResolvedFrames();
+		for (const ProfileFrame* frame : frames)
+		{
+			for (const ProfileSample& sample : frame->samples)
+			{
+				cpuTimes[sample.scope] += sample.cpuTime;
+				gpuTimes[sample.scope] += std::max(0.0, sample.gpuTime);
+			}
+		}
+		for (size_t i = 0; i < scopeNames.size() && !frames.empty(); i++)
+		{
+			cpuTimes[i] /= frames.size();
+			gpuTimes[i] /= frames.size();
+		}
+	}
+
+	// Print a per scope table of the averages
+	void printSummary() const
+	{
+		std::vector<double> cpuTimes, gpuTimes;
+		getAverages(cpuTimes, gpuTimes);
+		std::cout << "Profile, average of the last " << getResolvedFrames().size() << " frames (ms):" << std::endl;
+		std::cout << "  scope                          cpu       gpu" << std::endl;
+		for (size_t i = 0; i < scopeNames.size(); i++)
+		{
+			char line[128];
+			snprintf(line, sizeof(line), "  %-28s %8.3f  %8.3f", scopeNames[i].c_str(), cpuTimes[i], gpuTimes[i]);
+			std::cout << line << std::endl;
+		}
+	}
+
+	// Write the history as Chrome trace events (chrome://tracing or ui.perfetto.dev),
+	// CPU scopes on one track and GPU scopes on another
+	bool exportChromeTrace(const char* path) const
+	{
+		FILE* file = fopen(path, "w");
+		if (!file)
+		{
+			std::cout << "Failed to write profile trace " << path << std::endl;
+			return false;
+		}
+
+		fprintf(file, "{\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+		for (const ProfileFrame* frame : getResolvedFrames())
+		{
+			for (const ProfileSample& sample : frame->samples)
+			{
+				// trace times are in microseconds
+				const char* name = scopeNames[sample.scope].c_str();
+				fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld}}",
+					name, sample.cpuStart * 1000.0, sample.cpuTime * 1000.0, frame->index);
+				if (sample.gpuTime >= 0.0)
+					fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld}}",
+						name, sample.gpuStart * 1000.0, sample.gpuTime * 1000.0, frame->index);
+			}
+		}
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		bool ok = ferror(file) == 0;
+		fclose(file);
+		if (ok)
+			std::cout << "Wrote profile trace " << path << std::endl;
+		return ok;
+	}
+
+private:
+	// The timestamp queries of one in flight frame, two per sample. begins and ends hold the
+	// index of each sample's queries in the order they were issued.
+	struct QuerySlot
+	{
+		long long frameIndex = -1;
+		std::vector<GLuint> queries;
+		std::vector<int> begins;
+		std::vector<int> ends;
+		int used = 0;
+	};
+
+	std::chrono::steady_clock::time_point epoch;
+	double gpuOffset = 0.0;
+	bool calibrated = false;
+	bool enabled = false;
+	bool inFrame = false;
+	long long frameCount = 0;
+	long long lastResolved = -1;
+	int frameScope;
+
+	std::vector<std::string> scopeNames;
+	std::map<std::string, int> scopeIds;
+	std::vector<ProfileFrame> history;
+	std::vector<QuerySlot> querySlots;
+	std::vector<int> openScopes;
+
+	double getCpuTime() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// Next query of a slot, the pool grows to the largest number of scopes seen in a frame
+	GLuint getQuery(QuerySlot& slot)
+	{
+		if (slot.used == (int)slot.queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			slot.queries.push_back(query);
+		}
+		return slot.queries[slot.used++];
+	}
+
+	// Read the timestamps of the frame that last used this slot into its samples
+	void resolve(QuerySlot& slot)
+	{
+		if (slot.frameIndex >= 0 && slot.used > 0)
+		{
+			ProfileFrame& frame = history[slot.frameIndex % history.size()];
+			if (frame.index == slot.frameIndex)
+			{
+				for (size_t i = 0; i < frame.samples.size() && i < slot.begins.size(); i++)
+				{
+					if (slot.ends[i] < 0)
+						continue;
+					GLuint64 start = 0, stop = 0;
+					// blocks only if the GPU is more than PROFILER_QUERY_LATENCY frames behind
+					glGetQueryObjectui64v(slot.queries[slot.begins[i]], GL_QUERY_RESULT, &start);
+					glGetQueryObjectui64v(slot.queries[slot.ends[i]], GL_QUERY_RESULT, &stop);
+					frame.samples[i].gpuStart = start / 1000000.0 + gpuOffset;
+					frame.samples[i].gpuTime = (stop - start) / 1000000.0;
+				}
+				lastResolved = std::max(lastResolved, slot.frameIndex);
+			}
+		}
+		slot.begins.clear();
+		slot.ends.clear();
+		slot.frameIndex = -1;
+	}
+
+	Profiler(const Profiler&);
+	Profiler& operator=(const Profiler&);
+};
+
+// Times the enclosing block: Profiler::begin on construction, Profiler::end when it goes out of scope
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, int scope) : profiler(profiler)
+	{
+		profiler.begin(scope);
+	}
+	~ProfileScope()
+	{
+		profiler.end();
+	}
+
+private:
+	Profiler& profiler;
+
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+};
+
+// On screen frame time graph: one bar per recent frame, stacked from the GPU time of each top
+// level scope in its own color, with a white tick at the CPU frame time and lines at 60 and 30 fps.
+// There is no text rendering, Source.cpp puts the numbers in the window title instead.
+class ProfilerOverlay
+{
+public:
+	ProfilerOverlay() : shader("shaderfiles/profiler_overlay.vs", "shaderfiles/profiler_overlay.fs")
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// x, y in normalized device coordinates, then rgb
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	~ProfilerOverlay()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+	}
+
+	// Draw over whatever is in the framebuffer, graphHeightMs is the time at the top of the graph
+	void draw(const Profiler& profiler, float graphHeightMs = 33.3f)
+	{
+		vertices.clear();
+		const float left = -0.98f, bottom = -0.98f, width = 0.9f, height = 0.4f;
+		addQuad(left, bottom, width, height, glm::vec3(0.05f));
+
+		std::vector<const ProfileFrame*> frames = profiler.getResolvedFrames();
+		float barWidth = width / PROFILER_HISTORY;
+		for (size_t f = 0; f < frames.size(); f++)
+		{
+			float x = left + width - (frames.size() - f) * barWidth;
+			float y = bottom;
+			for (const ProfileSample& sample : frames[f]->samples)
+			{
+				if (sample.depth != 1 || sample.gpuTime <= 0.0)
+					continue;
+				float h = std::min((float)sample.gpuTime / graphHeightMs * height, bottom + height - y);
+				addQuad(x, y, barWidth, h, getScopeColor(sample.scope));
+				y += h;
+			}
+			if (!frames[f]->samples.empty())
+			{
+				float cpuY = bottom + std::min((float)frames[f]->samples[0].cpuTime / graphHeightMs, 1.0f) * height;
+				addQuad(x, cpuY, barWidth, 0.004f, glm::vec3(1.0f));
+			}
+		}
+		addQuad(left, bottom + 16.7f / graphHeightMs * height, width, 0.003f, glm::vec3(0.2f, 0.8f, 0.2f));
+		addQuad(left, bottom + 33.3f / graphHeightMs * height, width, 0.003f, glm::vec3(0.8f, 0.2f, 0.2f));
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// orphan last frame's vertices, the GPU may still be drawing them
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		glDisable(GL_DEPTH_TEST);
+		shader.use();
+		glBindVertexArray(VAO);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 5));
+		glBindVertexArray(0);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+	}
+
+	// Stable color per scope so a scope keeps its color in the graph
+	static glm::vec3 getScopeColor(int scope)
+	{
+		static const glm::vec3 colors[] = {
+			glm::vec3(0.90f, 0.30f, 0.25f), glm::vec3(0.25f, 0.60f, 0.90f), glm::vec3(0.95f, 0.75f, 0.20f),
+			glm::vec3(0.40f, 0.80f, 0.35f), glm::vec3(0.70f, 0.40f, 0.85f), glm::vec3(0.95f, 0.55f, 0.20f),
+			glm::vec3(0.30f, 0.85f, 0.80f), glm::vec3(0.85f, 0.45f, 0.65f)
+		};
+		return colors[scope % (sizeof(colors) / sizeof(colors[0]))];
+	}
+
+private:
+	Shader shader;
+	GLuint VAO = 0, VBO = 0;
+	std::vector<float> vertices;
+
+	void addQuad(float x, float y, float w, float h, glm::vec3 color)
+	{
+		const float corners[6][2] = { { x, y }, { x + w, y }, { x + w, y + h }, { x, y }, { x + w, y + h }, { x, y + h } };
+		for (int i = 0; i < 6; i++)
+		{
+			vertices.push_back(corners[i][0]);
+			vertices.push_back(corners[i][1]);
+			vertices.push_back(color.x);
+			vertices.push_back(color.y);
+			vertices.push_back(color.z);
+		}
+	}
+
+	ProfilerOverlay(const ProfilerOverlay&);
+	ProfilerOverlay& operator=(const ProfilerOverlay&);
+};
+
+#endif
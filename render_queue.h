@@ -0,0 +1,209 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bits of each field in a sort key, from the most significant down. Draws sort by pass first,
+// then by the state they need (shader, then material), then mesh and finally front to back.
+const int SORT_KEY_PASS_BITS = 4;
+const int SORT_KEY_SHADER_BITS = 8;
+const int SORT_KEY_MATERIAL_BITS = 12;
+const int SORT_KEY_MESH_BITS = 16;
+const int SORT_KEY_DEPTH_BITS = 24;
+
+const int SORT_KEY_MESH_SHIFT = SORT_KEY_DEPTH_BITS;
+const int SORT_KEY_MATERIAL_SHIFT = SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS;
+const int SORT_KEY_SHADER_SHIFT = SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS;
+const int SORT_KEY_PASS_SHIFT = SORT_KEY_SHADER_SHIFT + SORT_KEY_SHADER_BITS;
+
+inline uint64_t makeSortKey(int pass, int shader, int material, int mesh, uint32_t depth)
+{
+	return ((uint64_t)(pass & ((1 << SORT_KEY_PASS_BITS) - 1)) << SORT_KEY_PASS_SHIFT)
+		| ((uint64_t)(shader & ((1 << SORT_KEY_SHADER_BITS) - 1)) << SORT_KEY_SHADER_SHIFT)
+		| ((uint64_t)(material & ((1 << SORT_KEY_MATERIAL_BITS) - 1)) << SORT_KEY_MATERIAL_SHIFT)
+		| ((uint64_t)(mesh & ((1 << SORT_KEY_MESH_BITS) - 1)) << SORT_KEY_MESH_SHIFT)
+		| (depth & ((1u << SORT_KEY_DEPTH_BITS) - 1));
+}
+
+inline int getSortKeyPass(uint64_t key) { return (int)(key >> SORT_KEY_PASS_SHIFT) & ((1 << SORT_KEY_PASS_BITS) - 1); }
+inline int getSortKeyShader(uint64_t key) { return (int)(key >> SORT_KEY_SHADER_SHIFT) & ((1 << SORT_KEY_SHADER_BITS) - 1); }
+inline int getSortKeyMaterial(uint64_t key) { return (int)(key >> SORT_KEY_MATERIAL_SHIFT) & ((1 << SORT_KEY_MATERIAL_BITS) - 1); }
+
+// The pass, shader and material part of a key: draws with equal state can go in one submit
+inline uint64_t getSortKeyState(uint64_t key) { return key >> SORT_KEY_MATERIAL_SHIFT; }
+
+// View depth in 0..farPlane as a key field, closer draws sort first
+inline uint32_t quantizeSortDepth(float depth, float farPlane)
+{
+	float t = depth / farPlane;
+	t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+	return (uint32_t)(t * ((1u << SORT_KEY_DEPTH_BITS) - 1));
+}
+
+// Draws submitted as a sort key plus an item (whatever the caller needs to find the draw again)
+// and put in key order with an LSD radix sort, 8 bits per pass. Bytes that are the same in
+// every key, like unused passes or shaders, are skipped.
+class RenderQueue
+{
+public:
+	void clear()
+	{
+		keys.clear();
+		items.clear();
+	}
+
+	void submit(uint64_t key, uint32_t item)
+	{
+		keys.push_back(key);
+		items.push_back(item);
+	}
+
+	void sort()
+	{
+		size_t count = keys.size();
+		sortedKeys.resize(count);
+		sortedItems.resize(count);
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			size_t offsets[256] = {};
+			for (uint64_t key : keys)
+				offsets[(key >> shift) & 0xFF]++;
+			if (offsets[(keys.empty() ? 0 : keys[0] >> shift) & 0xFF] == count)
+				continue;
+
+			size_t sum = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				size_t bucket = offsets[i];
+				offsets[i] = sum;
+				sum += bucket;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t target = offsets[(keys[i] >> shift) & 0xFF]++;
+				sortedKeys[target] = keys[i];
+				sortedItems[target] = items[i];
+			}
+			keys.swap(sortedKeys);
+			items.swap(sortedItems);
+		}
+	}
+
+	size_t size() const { return keys.size(); }
+	uint64_t getKey(size_t i) const { return keys[i]; }
+	uint32_t getItem(size_t i) const { return items[i]; }
+
+private:
+	std::vector<uint64_t> keys, sortedKeys;
+	std::vector<uint32_t> items, sortedItems;
+};
+
+// What RenderStateCache did over a frame
+struct RenderStateStats
+{
+	int programChanges;
+	int textureChanges;
+	int vertexArrayChanges;
+	int avoided;	// calls skipped because the state was already set
+};
+
+const int RENDER_STATE_TEXTURE_UNITS = 8;
+
+// Remembers the bound program, VAO and textures and drops calls that would not change them.
+// Code binding things behind its back has to call invalidate() afterwards.
+class RenderStateCache
+{
+public:
+	RenderStateCache()
+	{
+		invalidate();
+		beginFrame();
+	}
+
+	void useProgram(GLuint program)
+	{
+		if (program == currentProgram)
+		{
+			stats.avoided++;
+			return;
+		}
+		glUseProgram(program);
+		currentProgram = program;
+		stats.programChanges++;
+	}
+
+	void bindVertexArray(GLuint vao)
+	{
+		if (vao == currentVertexArray)
+		{
+			stats.avoided++;
+			return;
+		}
+		glBindVertexArray(vao);
+		currentVertexArray = vao;
+		stats.vertexArrayChanges++;
+	}
+
+	void bindTexture(int unit, GLenum target, GLuint texture)
+	{
+		TextureBinding& binding = textures[unit];
+		if (binding.target == target && binding.texture == texture)
+		{
+			stats.avoided++;
+			return;
+		}
+		if (unit != activeUnit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = unit;
+		}
+		glBindTexture(target, texture);
+		binding.target = target;
+		binding.texture = texture;
+		stats.textureChanges++;
+	}
+
+	// Forget everything, the next calls all reach GL
+	void invalidate()
+	{
+		currentProgram = currentVertexArray = UNKNOWN;
+		activeUnit = -1;
+		for (TextureBinding& binding : textures)
+		{
+			binding.target = 0;
+			binding.texture = UNKNOWN;
+		}
+	}
+
+	// Start counting a new frame, the previous frame's counts stay in getLastFrameStats()
+	void beginFrame()
+	{
+		lastFrame = stats;
+		stats = RenderStateStats();
+	}
+
+	const RenderStateStats& getStats() const { return stats; }
+	const RenderStateStats& getLastFrameStats() const { return lastFrame; }
+
+private:
+	// no GL object has this name, so nothing compares equal after invalidate()
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+	struct TextureBinding
+	{
+		GLenum target;
+		GLuint texture;
+	};
+
+	GLuint currentProgram, currentVertexArray;
+	int activeUnit;
+	TextureBinding textures[RENDER_STATE_TEXTURE_UNITS];
+	RenderStateStats stats = RenderStateStats();
+	RenderStateStats lastFrame = RenderStateStats();
+};
+
+#endif
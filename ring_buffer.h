@@ -0,0 +1,147 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+
+// Sections in the ring: the CPU writes one while the GPU may still read the two before it
+const int RING_BUFFER_SECTIONS = 3;
+
+// Buffer for data rewritten every frame. With GL_ARB_buffer_storage (glad has to be generated
+// with it) the buffer is mapped once, persistent and coherent, and split into sections used
+// round robin; a write is a memcpy into the next section after waiting on the fence that
+// guards it. Without the extension every write orphans the buffer and uploads with
+// glBufferSubData, which needs no fences.
+class RingBuffer
+{
+public:
+	RingBuffer(GLenum target = GL_ARRAY_BUFFER) : target(target)
+	{
+		persistent = GLAD_GL_ARB_buffer_storage != 0;
+		for (int i = 0; i < RING_BUFFER_SECTIONS; i++)
+			fences[i] = 0;
+	}
+
+	~RingBuffer()
+	{
+		release();
+	}
+
+	// Copy size bytes into the buffer, returns the byte offset they start at in getBuffer().
+	// Earlier writes stay valid for draws issued before the next endFrame().
+	size_t write(const void* data, size_t size)
+	{
+		if (size > sectionSize || buffer == 0)
+			allocate(size + size / 2);
+
+		if (!persistent)
+		{
+			glBindBuffer(target, buffer);
+			glBufferData(target, sectionSize, NULL, GL_STREAM_DRAW);
+			glBufferSubData(target, 0, size, data);
+			glBindBuffer(target, 0);
+			return 0;
+		}
+
+		section = (section + 1) % RING_BUFFER_SECTIONS;
+		wait(section);
+		size_t offset = section * sectionSize;
+		std::memcpy(mapped + offset, data, size);
+		usedSections |= 1u << section;
+		return offset;
+	}
+
+	// Call once all of the frame's draws are issued: fences every section they may read, which
+	// includes the last one written even if nothing was written this frame
+	void endFrame()
+	{
+		if (!persistent || section < 0)
+			return;
+		usedSections |= 1u << section;
+		for (int i = 0; i < RING_BUFFER_SECTIONS; i++)
+		{
+			if (!(usedSections & (1u << i)))
+				continue;
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		usedSections = 0;
+	}
+
+	GLuint getBuffer() const { return buffer; }
+	bool isPersistent() const { return persistent; }
+
+private:
+	GLenum target;
+	GLuint buffer = 0;
+	size_t sectionSize = 0;
+	int section = -1;
+	unsigned int usedSections = 0;
+	GLsync fences[RING_BUFFER_SECTIONS];
+	unsigned char* mapped = NULL;
+	bool persistent = false;
+
+	void allocate(size_t size)
+	{
+		release();
+		// offsets are used for vertex attributes, keep sections nicely aligned
+		sectionSize = (size + 255) & ~(size_t)255;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, sectionSize * RING_BUFFER_SECTIONS, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(target, 0, sectionSize * RING_BUFFER_SECTIONS, flags);
+			if (!mapped)
+			{
+				std::cout << "Persistent mapping failed, falling back to orphaning" << std::endl;
+				persistent = false;
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(target, buffer);
+			}
+		}
+		if (!persistent)
+			glBufferData(target, sectionSize, NULL, GL_STREAM_DRAW);
+		glBindBuffer(target, 0);
+		section = -1;
+	}
+
+	void wait(int index)
+	{
+		if (!fences[index])
+			return;
+		// flush on the first try so the fence is sure to be signaled eventually
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fences[index], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(fences[index]);
+		fences[index] = 0;
+	}
+
+	// Waits for every section, the GPU may still be reading any of them
+	void release()
+	{
+		for (int i = 0; i < RING_BUFFER_SECTIONS; i++)
+			wait(i);
+		if (buffer)
+		{
+			if (mapped)
+			{
+				glBindBuffer(target, buffer);
+				glUnmapBuffer(target);
+				glBindBuffer(target, 0);
+				mapped = NULL;
+			}
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+		}
+		usedSections = 0;
+	}
+};
+
+#endif
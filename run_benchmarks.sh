@@ -0,0 +1,22 @@
+#!/bin/sh
+# Benchmark the table scene and its scaled variants (10x, 100x and 1000x tables of props) offscreen.
+#
+#   ./run_benchmarks.sh <renderer executable> [baseline results] [threshold]
+#
+# Results of every variant are collected in bench_results.txt; keep a copy of a good run as the
+# baseline. With a baseline every variant still runs, and the script fails at the end if any
+# was more than threshold (default 0.1 = 10%) slower or has no entry in the baseline.
+
+RENDERER=${1:?usage: run_benchmarks.sh <renderer executable> [baseline results] [threshold]}
+BASELINE=$2
+THRESHOLD=${3:-0.1}
+
+status=0
+for scale in 1 10 100 1000; do
+	if [ -n "$BASELINE" ]; then
+		"$RENDERER" scenes/table_scene.txt --benchmark --scale $scale --baseline "$BASELINE" --threshold "$THRESHOLD" || status=1
+	else
+		"$RENDERER" scenes/table_scene.txt --benchmark --scale $scale || status=1
+	fi
+done
+exit $status
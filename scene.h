@@ -0,0 +1,363 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+
+// Moved nodes per job when updateTransforms() rebuilds local matrices in parallel
+const size_t SCENE_TRANSFORM_GRAIN = 256;
+
+// Which shader pass a node is drawn in
+enum Scene_Pass {
+	PASS_NONE,	// grouping node, nothing to draw
+	PASS_LIT,	// lightingShader, textured and lit
+	PASS_LAMP	// lightCubeShader, also used as a point light position
+};
+
+// Geometry referenced by nodes, created once by the application from these parameters
+struct MeshDesc
+{
+	std::string name;
+	std::string type;	// plane, box, sphere, cylinder or file
+	float params[4] = { 0.0f, 0.0f, 0.0f, 0.0f };	// tessellation, size comes from the node scale
+	std::string path;	// file: a .mesh file written by mesh_converter
+};
+
+struct TextureDesc
+{
+	std::string name;
+	std::string path;
+};
+
+struct SceneNode
+{
+	std::string name;
+	int parent = -1;
+	std::vector<int> children;
+
+	int mesh = -1;		// index into Scene::meshes, -1 for none
+	int texture = -1;	// index into Scene::textures, -1 for none
+	Scene_Pass pass = PASS_NONE;
+
+	// local transform, rotation is euler angles in degrees
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 rotation = glm::vec3(0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+
+	// cached matrices, only rebuilt when the node or one of its parents changed
+	glm::mat4 localMatrix = glm::mat4(1.0f);
+	glm::mat4 worldMatrix = glm::mat4(1.0f);
+	bool localDirty = true;
+	bool worldChanged = false;
+};
+
+// Point light riding on a node, attenuated to nothing at radius
+struct LightDesc
+{
+	int node;
+	glm::vec3 color;
+	float radius;
+};
+
+// Scene graph loaded from a text description. Nodes are stored parent-before-child, so going
+// through moved nodes in index order updates every parent before its children.
+class Scene
+{
+public:
+	std::vector<MeshDesc> meshes;
+	std::vector<TextureDesc> textures;
+	std::vector<SceneNode> nodes;
+	std::vector<LightDesc> lights;
+
+	// Load a scene description. Format, one entry per line, '#' starts a comment:
+	//   mesh    <name> plane | box | sphere <sectors> <stacks> | cylinder <slices> | file <path>
+	//   texture <name> <path>
+	//   node    <name> <parent|-> <mesh|-> <texture|-> <lit|lamp|none> <px py pz> <rx ry rz> <sx sy sz>
+	//   light   <node> <r g b> <radius>
+	bool load(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "Scene failed to load at path: " << path << std::endl;
+			return false;
+		}
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+
+			std::istringstream in(line);
+			std::string keyword;
+			if (!(in >> keyword))
+				continue;
+
+			bool ok = true;
+			if (keyword == "mesh")
+			{
+				MeshDesc mesh;
+				ok = (bool)(in >> mesh.name >> mesh.type);
+				if (mesh.type == "file")
+					ok = ok && (bool)(in >> mesh.path);
+				else
+				{
+					for (int i = 0; i < 4 && (in >> mesh.params[i]); i++)
+						;
+				}
+				meshes.push_back(mesh);
+			}
+			else if (keyword == "texture")
+			{
+				TextureDesc texture;
+				ok = (bool)(in >> texture.name >> texture.path);
+				textures.push_back(texture);
+			}
+			else if (keyword == "node")
+			{
+				ok = parseNode(in);
+			}
+			else if (keyword == "light")
+			{
+				LightDesc light;
+				std::string node;
+				ok = (bool)(in >> node >> light.color.x >> light.color.y >> light.color.z >> light.radius);
+				ok = ok && (light.node = findNode(node)) >= 0 && light.radius > 0.0f;
+				lights.push_back(light);
+			}
+			else
+			{
+				ok = false;
+			}
+
+			if (!ok)
+			{
+				std::cout << "Scene " << path << " line " << lineNumber << ": could not parse \"" << line << "\"" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int findNode(const std::string& name) const { return findByName(nodes, name); }
+	int findMesh(const std::string& name) const { return findByName(meshes, name); }
+	int findTexture(const std::string& name) const { return findByName(textures, name); }
+
+	// Transform setters only flag the node, the matrices are rebuilt in updateTransforms()
+	void setPosition(int node, const glm::vec3& position)
+	{
+		nodes[node].position = position;
+		markDirty(node);
+	}
+
+	void setRotation(int node, const glm::vec3& rotation)
+	{
+		nodes[node].rotation = rotation;
+		markDirty(node);
+	}
+
+	void setScale(int node, const glm::vec3& scale)
+	{
+		nodes[node].scale = scale;
+		markDirty(node);
+	}
+
+	// Rebuild local matrices of changed nodes and world matrices of those nodes and their
+	// descendants. Returns how many world matrices were recomputed, worldChanged flags exactly
+	// those. Only the moved nodes are visited, a static frame returns right away. Local matrices
+	// only depend on their own node and are built in parallel on jobs if given; world matrices
+	// follow the hierarchy, parents first, on the calling thread.
+	int updateTransforms(JobSystem* jobs = NULL)
+	{
+		for (int index : changedNodes)
+			nodes[index].worldChanged = false;
+		changedNodes.clear();
+		if (dirtyNodes.empty())
+			return 0;
+
+		parallelFor(jobs, 0, dirtyNodes.size(), SCENE_TRANSFORM_GRAIN, [this](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+			{
+				SceneNode& node = nodes[dirtyNodes[i]];
+				glm::mat4 local = glm::mat4(1.0f);
+				local = glm::translate(local, node.position);
+				local = glm::rotate(local, glm::radians(node.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+				local = glm::rotate(local, glm::radians(node.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+				local = glm::rotate(local, glm::radians(node.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+				local = glm::scale(local, node.scale);
+				node.localMatrix = local;
+			}
+		});
+
+		// in index order a moved node below another one was already reached through the
+		// subtree of that one
+		std::sort(dirtyNodes.begin(), dirtyNodes.end());
+		std::vector<int> subtree;
+		for (int root : dirtyNodes)
+		{
+			if (nodes[root].worldChanged)
+				continue;
+			subtree.push_back(root);
+			while (!subtree.empty())
+			{
+				int index = subtree.back();
+				subtree.pop_back();
+				SceneNode& node = nodes[index];
+				node.worldMatrix = node.parent >= 0 ? nodes[node.parent].worldMatrix * node.localMatrix : node.localMatrix;
+				node.worldChanged = true;
+				node.localDirty = false;
+				changedNodes.push_back(index);
+				subtree.insert(subtree.end(), node.children.begin(), node.children.end());
+			}
+		}
+		dirtyNodes.clear();
+		return (int)changedNodes.size();
+	}
+
+	// Fill a grid with copies of the scene for stress testing: every top level node except the
+	// lamps is copied with its children, spacing apart in x and z, and so are the lights on
+	// them. The original stays in the middle and the copies are placed closest first. Returns
+	// the number of nodes added.
+	int replicate(int copies, float spacing)
+	{
+		std::vector<glm::ivec2> cells;
+		int radius = 0;
+		while ((2 * radius + 1) * (2 * radius + 1) < copies)
+			radius++;
+		for (int z = -radius; z <= radius; z++)
+		{
+			for (int x = -radius; x <= radius; x++)
+				cells.push_back(glm::ivec2(x, z));
+		}
+		std::stable_sort(cells.begin(), cells.end(), [](const glm::ivec2& a, const glm::ivec2& b) {
+			return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+		});
+
+		size_t originalCount = nodes.size();
+		size_t originalLights = lights.size();
+		nodes.reserve(originalCount * std::max(1, copies));
+		for (int copy = 1; copy < copies; copy++)
+		{
+			// nodes are appended in their original order, so parents still come before children
+			std::vector<int> remap(originalCount, -1);
+			glm::vec3 offset(cells[copy].x * spacing, 0.0f, cells[copy].y * spacing);
+			for (size_t i = 0; i < originalCount; i++)
+			{
+				const SceneNode& original = nodes[i];
+				bool copied = original.parent >= 0 ? remap[original.parent] >= 0 : original.pass != PASS_LAMP;
+				if (!copied)
+					continue;
+
+				SceneNode node = original;
+				node.name += "#" + std::to_string(copy);
+				node.children.clear();
+				node.localDirty = true;
+				if (node.parent >= 0)
+				{
+					node.parent = remap[node.parent];
+					nodes[node.parent].children.push_back((int)nodes.size());
+				}
+				else
+				{
+					node.position += offset;
+				}
+				remap[i] = (int)nodes.size();
+				dirtyNodes.push_back(remap[i]);
+				nodes.push_back(node);
+			}
+			for (size_t i = 0; i < originalLights; i++)
+			{
+				if (remap[lights[i].node] < 0)
+					continue;
+				LightDesc light = lights[i];
+				light.node = remap[light.node];
+				lights.push_back(light);
+			}
+		}
+		return (int)(nodes.size() - originalCount);
+	}
+
+	// World space position of a node (translation column of its world matrix)
+	glm::vec3 getWorldPosition(int node) const
+	{
+		return glm::vec3(nodes[node].worldMatrix[3]);
+	}
+
+private:
+	// nodes whose local transform changed since the last updateTransforms(), and the nodes
+	// whose world matrix that call recomputed
+	std::vector<int> dirtyNodes;
+	std::vector<int> changedNodes;
+
+	void markDirty(int node)
+	{
+		if (nodes[node].localDirty)
+			return;
+		nodes[node].localDirty = true;
+		dirtyNodes.push_back(node);
+	}
+
+	template <typename T>
+	static int findByName(const std::vector<T>& items, const std::string& name)
+	{
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			if (items[i].name == name)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	bool parseNode(std::istringstream& in)
+	{
+		SceneNode node;
+		std::string parent, mesh, texture, pass;
+		if (!(in >> node.name >> parent >> mesh >> texture >> pass))
+			return false;
+		if (!(in >> node.position.x >> node.position.y >> node.position.z))
+			return false;
+		if (!(in >> node.rotation.x >> node.rotation.y >> node.rotation.z))
+			return false;
+		if (!(in >> node.scale.x >> node.scale.y >> node.scale.z))
+			return false;
+
+		// references must point at entries declared earlier in the file
+		if (parent != "-" && (node.parent = findNode(parent)) < 0)
+			return false;
+		if (mesh != "-" && (node.mesh = findMesh(mesh)) < 0)
+			return false;
+		if (texture != "-" && (node.texture = findTexture(texture)) < 0)
+			return false;
+
+		if (pass == "lit")
+			node.pass = PASS_LIT;
+		else if (pass == "lamp")
+			node.pass = PASS_LAMP;
+		else if (pass == "none")
+			node.pass = PASS_NONE;
+		else
+			return false;
+
+		int index = (int)nodes.size();
+		if (node.parent >= 0)
+			nodes[node.parent].children.push_back(index);
+		dirtyNodes.push_back(index);
+		nodes.push_back(node);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+class Shader
+{
+public:
+	unsigned int ID;
+	// constructor generates the shader on the fly
+	// ------------------------------------------------------------------------
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	{
+		// 1. retrieve the vertex/fragment source code from filePath
+		std::string vertexCode;
+		std::string fragmentCode;
+		std::string geometryCode;
+		std::ifstream vShaderFile;
+		std::ifstream fShaderFile;
+		std::ifstream gShaderFile;
+		// ensure ifstream objects can throw exceptions:
+		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			// open files
+			vShaderFile.open(vertexPath);
+			fShaderFile.open(fragmentPath);
+			std::stringstream vShaderStream, fShaderStream;
+			// read file's buffer contents into streams
+			vShaderStream << vShaderFile.rdbuf();
+			fShaderStream << fShaderFile.rdbuf();
+			// close file handlers
+			vShaderFile.close();
+			fShaderFile.close();
+			// convert stream into string
+			vertexCode = vShaderStream.str();
+			fragmentCode = fShaderStream.str();
+			// if geometry shader path is present, also load a geometry shader
+			if (geometryPath != nullptr)
+			{
+				gShaderFile.open(geometryPath);
+				std::stringstream gShaderStream;
+				gShaderStream << gShaderFile.rdbuf();
+				gShaderFile.close();
+				geometryCode = gShaderStream.str();
+			}
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		const char* vShaderCode = vertexCode.c_str();
+		const char * fShaderCode = fragmentCode.c_str();
+		// 2. compile shaders
+		unsigned int vertex, fragment;
+		// vertex shader
+		vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		checkCompileErrors(vertex, "VERTEX");
+		// fragment Shader
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glCompileShader(fragment);
+		checkCompileErrors(fragment, "FRAGMENT");
+		// if geometry shader is given, compile geometry shader
+		unsigned int geometry;
+		if (geometryPath != nullptr)
+		{
+			const char * gShaderCode = geometryCode.c_str();
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+			checkCompileErrors(geometry, "GEOMETRY");
+		}
+		// shader Program
+		ID = glCreateProgram();
+		glAttachShader(ID, vertex);
+		glAttachShader(ID, fragment);
+		if (geometryPath != nullptr)
+			glAttachShader(ID, geometry);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		// delete the shaders as they're linked into our program now and no longer necessery
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		if (geometryPath != nullptr)
+			glDeleteShader(geometry);
+
+		// resolve every active uniform once so the setters below never hit the driver's string lookup
+		cacheUniformLocations();
+	}
+	// activate the shader
+	// ------------------------------------------------------------------------
+	void use()
+	{
+		glUseProgram(ID);
+	}
+	// binds a named std140 uniform block in this program to a buffer binding point
+	// ------------------------------------------------------------------------
+	void bindUniformBlock(const std::string &blockName, GLuint binding) const
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(ID, blockName.c_str());
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, blockIndex, binding);
+	}
+	// returns the cached location of a uniform, -1 if the program has no such uniform. The
+	// lookup does not allocate, but per frame uniforms should still keep their location and
+	// use the setters taking one.
+	// ------------------------------------------------------------------------
+	GLint getUniformLocation(const char* name) const
+	{
+		auto it = uniformLocations.find(name);
+		if (it != uniformLocations.end())
+			return it->second;
+
+		// not an active uniform at link time (e.g. optimized out) - remember that so we only ask once
+		GLint location = glGetUniformLocation(ID, name);
+		uniformLocations[name] = location;
+		return location;
+	}
+	// utility uniform functions, by name or by a location from getUniformLocation()
+	// ------------------------------------------------------------------------
+	void setBool(const char* name, bool value) const
+	{
+		setBool(getUniformLocation(name), value);
+	}
+	void setBool(GLint location, bool value) const
+	{
+		glUniform1i(location, (int)value);
+	}
+	// ------------------------------------------------------------------------
+	void setInt(const char* name, int value) const
+	{
+		setInt(getUniformLocation(name), value);
+	}
+	void setInt(GLint location, int value) const
+	{
+		glUniform1i(location, value);
+	}
+	// ------------------------------------------------------------------------
+	void setFloat(const char* name, float value) const
+	{
+		setFloat(getUniformLocation(name), value);
+	}
+	void setFloat(GLint location, float value) const
+	{
+		glUniform1f(location, value);
+	}
+	// ------------------------------------------------------------------------
+	void setVec2(const char* name, const glm::vec2 &value) const
+	{
+		setVec2(getUniformLocation(name), value);
+	}
+	void setVec2(GLint location, const glm::vec2 &value) const
+	{
+		glUniform2fv(location, 1, &value[0]);
+	}
+	void setVec2(const char* name, float x, float y) const
+	{
+		glUniform2f(getUniformLocation(name), x, y);
+	}
+	// ------------------------------------------------------------------------
+	void setVec3(const char* name, const glm::vec3 &value) const
+	{
+		setVec3(getUniformLocation(name), value);
+	}
+	void setVec3(GLint location, const glm::vec3 &value) const
+	{
+		glUniform3fv(location, 1, &value[0]);
+	}
+	void setVec3(const char* name, float x, float y, float z) const
+	{
+		glUniform3f(getUniformLocation(name), x, y, z);
+	}
+	// ------------------------------------------------------------------------
+	void setVec4(const char* name, const glm::vec4 &value) const
+	{
+		setVec4(getUniformLocation(name), value);
+	}
+	void setVec4(GLint location, const glm::vec4 &value) const
+	{
+		glUniform4fv(location, 1, &value[0]);
+	}
+	void setVec4(const char* name, float x, float y, float z, float w) const
+	{
+		glUniform4f(getUniformLocation(name), x, y, z, w);
+	}
+	// ------------------------------------------------------------------------
+	void setMat2(const char* name, const glm::mat2 &mat) const
+	{
+		setMat2(getUniformLocation(name), mat);
+	}
+	void setMat2(GLint location, const glm::mat2 &mat) const
+	{
+		glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+	// ------------------------------------------------------------------------
+	void setMat3(const char* name, const glm::mat3 &mat) const
+	{
+		setMat3(getUniformLocation(name), mat);
+	}
+	void setMat3(GLint location, const glm::mat3 &mat) const
+	{
+		glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+	// ------------------------------------------------------------------------
+	void setMat4(const char* name, const glm::mat4 &mat) const
+	{
+		setMat4(getUniformLocation(name), mat);
+	}
+	void setMat4(GLint location, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+private:
+	// uniform name -> location, filled once after linking. std::less<> lets find() take the
+	// name as a const char* without building a string.
+	mutable std::map<std::string, GLint, std::less<>> uniformLocations;
+
+	// query all active uniforms of the linked program and store their locations
+	// ------------------------------------------------------------------------
+	void cacheUniformLocations()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+			std::string name(nameBuffer.data(), length);
+
+			// members of uniform blocks report -1 here, they are set through their buffer instead
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			if (location < 0)
+				continue;
+			uniformLocations[name] = location;
+
+			// arrays are reported once as "name[0]", register the plain name and every element too
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base = name.substr(0, name.size() - 3);
+				uniformLocations[base] = location;
+				for (GLint e = 1; e < size; e++)
+				{
+					std::string element = base + "[" + std::to_string(e) + "]";
+					uniformLocations[element] = glGetUniformLocation(ID, element.c_str());
+				}
+			}
+		}
+	}
+
+	// utility function for checking shader compilation/linking errors.
+	// ------------------------------------------------------------------------
+	void checkCompileErrors(GLuint shader, std::string type)
+	{
+		GLint success;
+		GLchar infoLog[1024];
+		if (type != "PROGRAM")
+		{
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+		else
+		{
+			glGetProgramiv(shader, GL_LINK_STATUS, &success);
+			if (!success)
+			{
+				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+	}
+};
+#endif
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance model matrix, see instancing.h
+layout (location = 3) in mat4 aModel;
+// position decode of the instance's mesh, see vertex_format.h: packed positions are 0..1 across the
+// mesh bounds, float meshes use scale 1 and offset 0
+layout (location = 8) in vec3 aPositionScale;
+layout (location = 9) in vec3 aPositionOffset;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    gl_Position = projection * view * aModel * vec4(position, 1.0);
+}
@@ -0,0 +1,230 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    // one layer per scene texture, see texture_array.h
+    sampler2DArray diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+// keep in sync with PointLight / SpotLight in lights.h (std140 for the spot light)
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float radius;
+};
+
+struct SpotLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutOff;
+    vec3 specular;
+    float outerCutOff;
+};
+
+layout (std140) uniform Lighting
+{
+    SpotLight spotLight;
+};
+
+// Clustered point lights, see clustered_lights.h: four texels per light, a (first, count)
+// range of the index list per cluster, and the index list
+uniform samplerBuffer pointLightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterDepthScaleBias;
+
+// Shadow maps, see shadows.h: one map for the spot light, and an atlas with a row of six cube
+// faces for each of the first point lights. pointShadowLights holds the light index a row
+// belongs to, -1 for none.
+#define MAX_SHADOWED_POINT_LIGHTS 4
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 spotShadowMatrix;
+uniform sampler2DShadow pointShadowAtlas;
+uniform mat4 pointShadowMatrices[MAX_SHADOWED_POINT_LIGHTS * 6];
+uniform int pointShadowLights[MAX_SHADOWED_POINT_LIGHTS];
+// moves the lookup off the surface a little, against shadow acne
+const float SHADOW_NORMAL_OFFSET = 0.002;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+flat in int MaterialLayer;
+
+uniform vec3 viewPos;
+uniform Material material;
+uniform mat4 view;
+uniform mat4 projection;
+
+// function prototypes
+int FindCluster(vec3 fragPos);
+PointLight FetchPointLight(int index);
+float FilterShadow(sampler2DShadow map, vec3 coords, vec2 tileMin, vec2 tileMax);
+float SpotShadow(vec3 normal, vec3 fragPos);
+float PointShadow(int index, vec3 lightPos, vec3 normal, vec3 fragPos);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+
+void main()
+{
+    // properties
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+    // phase 1: the point lights reaching this fragment's cluster
+    vec3 result = vec3(0.0);
+    uvec2 range = texelFetch(clusterRanges, FindCluster(FragPos)).xy;
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        PointLight light = FetchPointLight(index);
+        result += CalcPointLight(light, norm, FragPos, viewDir, PointShadow(index, light.position, norm, FragPos));
+    }
+    // phase 2: spot light
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir, SpotShadow(norm, FragPos));
+
+    FragColor = vec4(result, 1.0);
+}
+
+// cluster of a fragment: screen tile from its NDC position, depth slice from its view depth
+int FindCluster(vec3 fragPos)
+{
+    vec4 viewSpace = view * vec4(fragPos, 1.0);
+    vec4 clip = projection * viewSpace;
+    ivec2 tile = clamp(ivec2((clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterGrid.xy)), ivec2(0), clusterGrid.xy - 1);
+    int slice = clamp(int(log(-viewSpace.z) * clusterDepthScaleBias.x + clusterDepthScaleBias.y), 0, clusterGrid.z - 1);
+    return (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 a = texelFetch(pointLightData, index * 4);
+    vec4 b = texelFetch(pointLightData, index * 4 + 1);
+    vec4 c = texelFetch(pointLightData, index * 4 + 2);
+    vec4 d = texelFetch(pointLightData, index * 4 + 3);
+    return PointLight(a.xyz, a.w, b.xyz, b.w, c.xyz, c.w, d.xyz, d.w);
+}
+
+// 3x3 PCF: every tap is already a bilinear filtered comparison. Taps stay inside the tile
+// (atlas coordinates) so they never read a neighbouring cube face.
+float FilterShadow(sampler2DShadow map, vec3 coords, vec2 tileMin, vec2 tileMax)
+{
+    vec2 texel = 1.0 / vec2(textureSize(map, 0));
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++)
+    {
+        for(int y = -1; y <= 1; y++)
+        {
+            vec2 uv = clamp(coords.xy + vec2(x, y) * texel, tileMin + texel * 0.5, tileMax - texel * 0.5);
+            lit += texture(map, vec3(uv, coords.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+// lit fraction of a fragment for the spot light, 1 outside the map
+float SpotShadow(vec3 normal, vec3 fragPos)
+{
+    vec4 clip = spotShadowMatrix * vec4(fragPos + normal * SHADOW_NORMAL_OFFSET, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    if(clip.w <= 0.0 || coords.z > 1.0)
+        return 1.0;
+    return FilterShadow(spotShadowMap, coords, vec2(0.0), vec2(1.0));
+}
+
+// lit fraction for point light index, 1 if it has no shadow map
+float PointShadow(int index, vec3 lightPos, vec3 normal, vec3 fragPos)
+{
+    int slot = -1;
+    for(int i = 0; i < MAX_SHADOWED_POINT_LIGHTS; i++)
+    {
+        if(pointShadowLights[i] == index)
+            slot = i;
+    }
+    if(slot < 0)
+        return 1.0;
+
+    // cube face by the major axis, in the order +x, -x, +y, -y, +z, -z
+    vec3 position = fragPos + normal * SHADOW_NORMAL_OFFSET;
+    vec3 direction = position - lightPos;
+    vec3 size = abs(direction);
+    int face;
+    if(size.x >= size.y && size.x >= size.z)
+        face = direction.x > 0.0 ? 0 : 1;
+    else if(size.y >= size.z)
+        face = direction.y > 0.0 ? 2 : 3;
+    else
+        face = direction.z > 0.0 ? 4 : 5;
+
+    vec4 clip = pointShadowMatrices[slot * 6 + face] * vec4(position, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    if(coords.z > 1.0)
+        return 1.0;
+    vec2 tileSize = vec2(1.0 / 6.0, 1.0 / float(MAX_SHADOWED_POINT_LIGHTS));
+    vec2 tileMin = vec2(face, slot) * tileSize;
+    coords.xy = tileMin + clamp(coords.xy, 0.0, 1.0) * tileSize;
+    return FilterShadow(pointShadowAtlas, coords, tileMin, tileMin + tileSize);
+}
+
+// calculates the color when using a point light, shadow scales the direct light.
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out to nothing at the radius, the light is not in the clusters beyond it
+    float fade = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= fade * fade;
+    // combine results
+    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vec3(TexCoords, MaterialLayer)));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, vec3(TexCoords, MaterialLayer)));
+    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    ambient *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a spot light, shadow scales the direct light.
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // spotlight intensity
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vec3(TexCoords, MaterialLayer)));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, vec3(TexCoords, MaterialLayer)));
+    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity * shadow;
+    specular *= attenuation * intensity * shadow;
+    return (ambient + diffuse + specular);
+}
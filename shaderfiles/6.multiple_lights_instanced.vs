@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance attributes, see instancing.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in int aMaterial;
+// position decode of the instance's mesh, see vertex_format.h: packed positions are 0..1 across the
+// mesh bounds, float meshes use scale 1 and offset 0
+layout (location = 8) in vec3 aPositionScale;
+layout (location = 9) in vec3 aPositionOffset;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out int MaterialLayer;
+
+uniform mat4 view;
+uniform mat4 projection;
+// set when textures were uploaded without flipping them on load
+uniform bool flipTexCoords;
+
+// must match depth_prepass.vs exactly for the depth test against the pre-pass
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    FragPos = vec3(aModel * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(aModel))) * aNormal;
+    TexCoords = flipTexCoords ? vec2(aTexCoords.x, 1.0 - aTexCoords.y) : aTexCoords;
+    MaterialLayer = aMaterial;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance model matrix, see instancing.h
+layout (location = 3) in mat4 aModel;
+// position decode of the instance's mesh, see vertex_format.h
+layout (location = 8) in vec3 aPositionScale;
+layout (location = 9) in vec3 aPositionOffset;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// The lit pass only shades what this wrote, so the depth has to come out bit for bit the
+// same: same expression as 6.multiple_lights_instanced.vs, and invariant in both.
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    vec3 fragPos = vec3(aModel * vec4(position, 1.0));
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+out float Depth;
+
+// the level above (or the depth buffer copy), see occlusion.h
+uniform sampler2D source;
+
+// Farthest depth of the 2x2 source texels under this one. Odd sizes fold their last row and
+// column into the last texel, so it covers three.
+void main()
+{
+    ivec2 size = textureSize(source, 0);
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = first + 1;
+    if(first.x + 3 == size.x)
+        last.x++;
+    if(first.y + 3 == size.y)
+        last.y++;
+    last = min(last, size - 1);
+
+    float depth = 0.0;
+    for(int y = first.y; y <= last.y; y++)
+    {
+        for(int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+    }
+    Depth = depth;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance model matrix, see instancing.h
+layout (location = 3) in mat4 aModel;
+// position decode of the instance's mesh, see vertex_format.h
+layout (location = 8) in vec3 aPositionScale;
+layout (location = 9) in vec3 aPositionOffset;
+
+// the spot light's view projection or one cube face of a point light, see shadows.h
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    vec3 position = aPos * aPositionScale + aPositionOffset;
+    gl_Position = lightViewProjection * aModel * vec4(position, 1.0);
+}
@@ -0,0 +1,275 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bounds.h"
+#include "culling.h"
+#include "lights.h"
+#include "scene.h"
+
+// Spot light map size, and the size of one cube face of a point light in the atlas
+const int SPOT_SHADOW_SIZE = 2048;
+const int POINT_SHADOW_FACE_SIZE = 512;
+// Point lights with shadows, the first ones (the lamps) get them. Has to match the lighting
+// shader's MAX_SHADOWED_POINT_LIGHTS.
+const int MAX_SHADOWED_POINT_LIGHTS = 4;
+const int POINT_SHADOW_FACES = 6;
+
+// Texture units the lighting shader samples the maps from
+const int SPOT_SHADOW_UNIT = 5;
+const int POINT_SHADOW_UNIT = 6;
+
+// Depth range of the light projections close to the light
+const float SHADOW_NEAR_PLANE = 0.05f;
+
+// Shadow maps for the spot light and the first point lights. The spot light has a 2D depth map
+// over its cone. A point light has a cube map's six 90 degree faces laid out as one row of
+// tiles in a depth atlas (a row per light), so all of them are a single sampler2DShadow and
+// the shader picks the face itself. Both compare in hardware with linear filtering, the shader
+// adds a 3x3 PCF kernel on top.
+//
+// The lights hardly ever move, so the maps are cached: a map is only rendered again when its
+// light changes or a caster inside the light's volume moves (see invalidate()). Most frames
+// render no shadow map at all.
+class ShadowMaps
+{
+public:
+	ShadowMaps()
+	{
+		spotTexture = createDepthTexture(SPOT_SHADOW_SIZE, SPOT_SHADOW_SIZE);
+		pointTexture = createDepthTexture(POINT_SHADOW_FACE_SIZE * POINT_SHADOW_FACES, POINT_SHADOW_FACE_SIZE * MAX_SHADOWED_POINT_LIGHTS);
+		glGenFramebuffers(1, &FBO);
+
+		spotDirty = true;
+		for (int i = 0; i < MAX_SHADOWED_POINT_LIGHTS; i++)
+		{
+			pointLights[i] = -1;
+			pointDirty[i] = false;
+			std::memset(static_cast<void*>(&points[i]), 0, sizeof(PointLight));
+			for (int face = 0; face < POINT_SHADOW_FACES; face++)
+				pointMatrices[i * POINT_SHADOW_FACES + face] = glm::mat4(1.0f);
+		}
+		std::memset(static_cast<void*>(&spot), 0, sizeof(SpotLight));
+		spotMatrix = glm::mat4(1.0f);
+	}
+
+	~ShadowMaps()
+	{
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteTextures(1, &spotTexture);
+		glDeleteTextures(1, &pointTexture);
+	}
+
+	// The map is redrawn if the light moved, turned or got a different reach
+	void setSpotLight(const SpotLight& light)
+	{
+		if (std::memcmp(&spot, &light, sizeof(SpotLight)) == 0)
+			return;
+		spot = light;
+		// the view looks down the cone, any up vector not along it will do
+		glm::vec3 direction = glm::normalize(light.direction);
+		glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		float angle = 2.0f * std::acos(light.outerCutOff);
+		glm::mat4 projection = glm::perspective(angle, 1.0f, SHADOW_NEAR_PLANE, std::max(getSpotLightRange(light), SHADOW_NEAR_PLANE * 2.0f));
+		spotMatrix = projection * glm::lookAt(light.position, light.position + direction, up);
+		spotFrustum.extract(spotMatrix);
+		spotDirty = true;
+	}
+
+	// Give shadow slot a point light (index is its index in ClusteredLights, -1 frees the slot).
+	// Only a change of position or radius redraws it, colors do not matter to the map.
+	void setPointLight(int slot, int index, const PointLight& light)
+	{
+		if (pointLights[slot] == index && (index < 0 || (points[slot].position == light.position && points[slot].radius == light.radius)))
+			return;
+		pointLights[slot] = index;
+		points[slot] = light;
+		pointDirty[slot] = index >= 0;
+		if (index < 0)
+			return;
+
+		// +x, -x, +y, -y, +z, -z: the shader picks the face by the major axis in the same order
+		static const glm::vec3 directions[POINT_SHADOW_FACES] = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+		};
+		static const glm::vec3 ups[POINT_SHADOW_FACES] = {
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+		};
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, std::max(light.radius, SHADOW_NEAR_PLANE * 2.0f));
+		for (int face = 0; face < POINT_SHADOW_FACES; face++)
+			pointMatrices[slot * POINT_SHADOW_FACES + face] = projection * glm::lookAt(light.position, light.position + directions[face], ups[face]);
+	}
+
+	// A caster's world box: every map whose light volume it touches is redrawn. Call with where
+	// a moved caster was and with where it is now, see collectMovedCasters().
+	void invalidate(const BoundingBox& box)
+	{
+		if (box.min.x > box.max.x)
+			return;
+		if (!spotDirty && spotFrustum.test(box) != FRUSTUM_OUTSIDE)
+			spotDirty = true;
+		for (int i = 0; i < MAX_SHADOWED_POINT_LIGHTS; i++)
+		{
+			if (pointLights[i] < 0 || pointDirty[i])
+				continue;
+			// distance from the light to the closest point of the box
+			glm::vec3 offset = glm::max(box.min - points[i].position, glm::max(glm::vec3(0.0f), points[i].position - box.max));
+			if (glm::dot(offset, offset) < points[i].radius * points[i].radius)
+				pointDirty[i] = true;
+		}
+	}
+
+	bool needsRender() const
+	{
+		bool dirty = spotDirty;
+		for (int i = 0; i < MAX_SHADOWED_POINT_LIGHTS; i++)
+			dirty = dirty || pointDirty[i];
+		return dirty;
+	}
+
+	// Render every map that is out of date, returns how many views (spot map or cube faces)
+	// that took. drawCasters() draws all shadow casters with the bound depth program, which
+	// gets the light's view projection in its "lightViewProjection" uniform. Viewport and
+	// framebuffer are restored afterwards.
+	template <typename DrawCasters>
+	int render(GLuint program, DrawCasters drawCasters)
+	{
+		if (!needsRender())
+			return 0;
+
+		GLint viewport[4];
+		GLint framebuffer = 0;
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		GLint matrixLocation = glGetUniformLocation(program, "lightViewProjection");
+
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		// slope scaled bias against acne, the shader adds a normal offset
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		int views = 0;
+		if (spotDirty)
+		{
+			attach(spotTexture);
+			glViewport(0, 0, SPOT_SHADOW_SIZE, SPOT_SHADOW_SIZE);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glUniformMatrix4fv(matrixLocation, 1, GL_FALSE, &spotMatrix[0][0]);
+			drawCasters();
+			spotDirty = false;
+			views++;
+		}
+
+		bool atlasAttached = false;
+		glEnable(GL_SCISSOR_TEST);
+		for (int i = 0; i < MAX_SHADOWED_POINT_LIGHTS; i++)
+		{
+			if (!pointDirty[i])
+				continue;
+			if (!atlasAttached)
+				attach(pointTexture);
+			atlasAttached = true;
+			for (int face = 0; face < POINT_SHADOW_FACES; face++)
+			{
+				// clear only this light's tile
+				glViewport(face * POINT_SHADOW_FACE_SIZE, i * POINT_SHADOW_FACE_SIZE, POINT_SHADOW_FACE_SIZE, POINT_SHADOW_FACE_SIZE);
+				glScissor(face * POINT_SHADOW_FACE_SIZE, i * POINT_SHADOW_FACE_SIZE, POINT_SHADOW_FACE_SIZE, POINT_SHADOW_FACE_SIZE);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				glUniformMatrix4fv(matrixLocation, 1, GL_FALSE, &pointMatrices[i * POINT_SHADOW_FACES + face][0][0]);
+				drawCasters();
+				views++;
+			}
+			pointDirty[i] = false;
+		}
+		glDisable(GL_SCISSOR_TEST);
+		glDisable(GL_POLYGON_OFFSET_FILL);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		renderedViews += views;
+		return views;
+	}
+
+	// Matrices, slots and samplers for the lighting shader; it has to be the bound program
+	void setUniforms(GLuint program) const
+	{
+		glUniform1i(glGetUniformLocation(program, "spotShadowMap"), SPOT_SHADOW_UNIT);
+		glUniform1i(glGetUniformLocation(program, "pointShadowAtlas"), POINT_SHADOW_UNIT);
+		glUniformMatrix4fv(glGetUniformLocation(program, "spotShadowMatrix"), 1, GL_FALSE, &spotMatrix[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(program, "pointShadowMatrices"), MAX_SHADOWED_POINT_LIGHTS * POINT_SHADOW_FACES, GL_FALSE, &pointMatrices[0][0][0]);
+		glUniform1iv(glGetUniformLocation(program, "pointShadowLights"), MAX_SHADOWED_POINT_LIGHTS, pointLights);
+	}
+
+	GLuint getSpotTexture() const { return spotTexture; }
+	GLuint getPointTexture() const { return pointTexture; }
+	// spot maps and cube faces rendered since the start
+	long long getRenderedViews() const { return renderedViews; }
+
+private:
+	GLuint FBO = 0;
+	GLuint spotTexture = 0, pointTexture = 0;
+	SpotLight spot;
+	glm::mat4 spotMatrix;
+	Frustum spotFrustum;
+	bool spotDirty;
+	int pointLights[MAX_SHADOWED_POINT_LIGHTS];
+	PointLight points[MAX_SHADOWED_POINT_LIGHTS];
+	glm::mat4 pointMatrices[MAX_SHADOWED_POINT_LIGHTS * POINT_SHADOW_FACES];
+	bool pointDirty[MAX_SHADOWED_POINT_LIGHTS];
+	long long renderedViews = 0;
+
+	// Depth texture compared in hardware: texture() on a sampler2DShadow returns the lit
+	// fraction, filtered over the four nearest texels. Outside the map counts as lit.
+	static GLuint createDepthTexture(int width, int height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	void attach(GLuint texture)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Shadow map framebuffer is not complete" << std::endl;
+	}
+};
+
+// The world boxes of every lit node whose transform changed, appended to boxes for
+// ShadowMaps::invalidate(). Call it before FrustumCuller::updateBounds() (where they were) and
+// again after (where they are now), so shadows are both removed and added.
+inline void collectMovedCasters(const Scene& scene, const FrustumCuller& culler, std::vector<BoundingBox>& boxes)
+{
+	for (size_t i = 0; i < scene.nodes.size() && i < culler.getNodeCount(); i++)
+	{
+		const SceneNode& node = scene.nodes[i];
+		if (node.worldChanged && node.mesh >= 0 && node.pass == PASS_LIT)
+			boxes.push_back(culler.getWorldBox((int)i));
+	}
+}
+
+#endif
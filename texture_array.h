@@ -0,0 +1,136 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "texture_format.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// The scene's materials as the layers of one GL_TEXTURE_2D_ARRAY, so objects with different
+// textures need no texture binds between them and can share batches and draws. The instance
+// data carries the layer (InstanceData::material). Layers are BC1 where the driver can sample
+// S3TC, a quarter of a byte per texel with the mips, and RGBA8 otherwise. Every layer has a
+// full mip chain, filled level by level by TextureLoader::loadLayer(), and starts out mid grey.
+class TextureArray
+{
+public:
+	TextureArray(int width, int height, int layers) : width(width), height(height), layers(std::max(layers, 1))
+	{
+		compressed = hasExtension("GL_EXT_texture_compression_s3tc");
+		levels = 1;
+		while ((width | height) >> levels)
+			levels++;
+
+		// mid grey placeholder: a solid BC1 block has both end points grey and every index 0
+		const unsigned char greyBlock[8] = { 0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0 };
+		std::vector<unsigned char> grey(getLevelSize(0));
+		if (compressed)
+		{
+			for (size_t i = 0; i < grey.size(); i += sizeof(greyBlock))
+				std::memcpy(&grey[i], greyBlock, sizeof(greyBlock));
+		}
+		else
+		{
+			std::fill(grey.begin(), grey.end(), 128);
+		}
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		for (int level = 0; level < levels; level++)
+		{
+			int levelWidth = getLevelWidth(level), levelHeight = getLevelHeight(level);
+			std::vector<unsigned char> layerData((size_t)getLevelSize(level) * this->layers);
+			for (int layer = 0; layer < this->layers; layer++)
+				std::memcpy(&layerData[(size_t)layer * getLevelSize(level)], grey.data(), getLevelSize(level));
+			if (compressed)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, levelWidth, levelHeight, this->layers,
+					0, (GLsizei)layerData.size(), layerData.data());
+			}
+			else
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, this->layers,
+					0, GL_RGBA, GL_UNSIGNED_BYTE, layerData.data());
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+
+	~TextureArray()
+	{
+		glDeleteTextures(1, &texture);
+	}
+
+	// Replace one mip level of a layer with getLevelSize(level) bytes in the array's format, from
+	// client memory or, with a pixel unpack buffer bound, an offset into it
+	void setLevel(int layer, int level, const void* data)
+	{
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		if (compressed)
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, getLevelWidth(level), getLevelHeight(level), 1,
+				GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei)getLevelSize(level), data);
+		}
+		else
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, getLevelWidth(level), getLevelHeight(level), 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, data);
+		}
+	}
+
+	void bind(int unit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	}
+
+	GLuint getTexture() const { return texture; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getLayerCount() const { return layers; }
+	int getLevelCount() const { return levels; }
+	// BC1 (CTEX_FORMAT_BC1) if set, RGBA8 otherwise
+	bool isCompressed() const { return compressed; }
+
+	int getLevelWidth(int level) const { return std::max(width >> level, 1); }
+	int getLevelHeight(int level) const { return std::max(height >> level, 1); }
+	// bytes of one layer at level
+	uint32_t getLevelSize(int level) const
+	{
+		if (compressed)
+			return getCompressedLevelSize(CTEX_FORMAT_BC1, getLevelWidth(level), getLevelHeight(level));
+		return (uint32_t)getLevelWidth(level) * getLevelHeight(level) * 4;
+	}
+
+private:
+	GLuint texture = 0;
+	int width, height, layers;
+	int levels;
+	bool compressed;
+
+	static bool hasExtension(const char* name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && std::strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+};
+
+#endif
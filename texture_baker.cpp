@@ -0,0 +1,83 @@
+// Offline texture baker: turns source images into .ctex files holding a full BC1 mip chain at
+// the material layer size, so the renderer can fill its texture array layers straight from them
+// and skip image decoding, resampling, mip generation and compression at startup.
+//
+// Usage: texture_baker [--flip] image [image ...]
+//   --flip  store rows bottom first, only for a renderer built with FLIP_IMAGES_ON_LOAD = true
+// Each image is written next to its source with the extension changed to .ctex.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "image_flip.h"
+#include "texture_compress.h"
+#include "texture_format.h"
+
+static bool bakeTexture(const std::string& sourcePath, bool flip)
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+	if (!pixels)
+	{
+		std::cout << "Texture failed to load at path: " << sourcePath << std::endl;
+		return false;
+	}
+	if (flip)
+		flipImageVertically(pixels, width, height, 4);
+
+	// the same resampling the renderer would do, so the file fills a layer as it is
+	std::vector<unsigned char> layer((size_t)MATERIAL_LAYER_SIZE * MATERIAL_LAYER_SIZE * 4);
+	resizeImage(pixels, width, height, 4, layer.data(), MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE);
+	stbi_image_free(pixels);
+
+	std::vector<CompressedMipLevel> levels;
+	std::vector<std::vector<unsigned char>> levelData;
+	buildMipChain(std::move(layer), MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, true, levels, levelData);
+
+	std::string outputPath = getBakedTexturePath(sourcePath);
+	if (!writeCompressedTexture(outputPath.c_str(), CTEX_FORMAT_BC1, flip ? CTEX_FLAG_FLIPPED : 0, levels, levelData))
+	{
+		std::cout << "Failed to write " << outputPath << std::endl;
+		return false;
+	}
+
+	size_t compressedBytes = 0;
+	for (const std::vector<unsigned char>& data : levelData)
+		compressedBytes += data.size();
+	std::cout << sourcePath << " -> " << outputPath << ": " << width << "x" << height << " resampled to " << MATERIAL_LAYER_SIZE << "x"
+		<< MATERIAL_LAYER_SIZE << ", " << levels.size() << " levels, " << compressedBytes / 1024 << " KB (RGBA8 with mips ~"
+		<< (size_t)MATERIAL_LAYER_SIZE * MATERIAL_LAYER_SIZE * 4 * 4 / 3 / 1024 << " KB)" << std::endl;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool flip = false;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--flip")
+			flip = true;
+		else
+			inputs.push_back(argument);
+	}
+
+	if (inputs.empty())
+	{
+		std::cout << "Usage: texture_baker [--flip] image [image ...]" << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+	for (const std::string& input : inputs)
+	{
+		if (!bakeTexture(input, flip))
+			failures++;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "texture_format.h"
+
+// CPU side of the material textures, shared by texture_baker.cpp and TextureLoader: resampling,
+// mip generation and BC1 compression. The baker runs it offline; the loader only for images
+// that have no baked file.
+
+// Resample an image to width x height RGBA. Every output texel averages the source texels it
+// covers, so large reductions do not alias; when enlarging it takes the nearest one.
+inline void resizeImage(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+	unsigned char* target, int width, int height)
+{
+	for (int y = 0; y < height; y++)
+	{
+		int y0 = (int)((long long)y * sourceHeight / height);
+		int y1 = std::max(y0 + 1, (int)((long long)(y + 1) * sourceHeight / height));
+		for (int x = 0; x < width; x++)
+		{
+			int x0 = (int)((long long)x * sourceWidth / width);
+			int x1 = std::max(x0 + 1, (int)((long long)(x + 1) * sourceWidth / width));
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (int sy = y0; sy < y1; sy++)
+			{
+				const unsigned char* row = source + ((size_t)sy * sourceWidth + x0) * channels;
+				for (int sx = x0; sx < x1; sx++, row += channels)
+				{
+					for (int c = 0; c < channels; c++)
+						sum[c] += row[c];
+				}
+			}
+			unsigned int count = (unsigned int)((y1 - y0) * (x1 - x0));
+			unsigned char* texel = target + ((size_t)y * width + x) * 4;
+			for (int c = 0; c < channels; c++)
+				texel[c] = (unsigned char)((sum[c] + count / 2) / count);
+			// grey images spread to rgb, missing alpha is opaque
+			for (int c = channels; c < 3; c++)
+				texel[c] = texel[0];
+			if (channels < 4)
+				texel[3] = 255;
+		}
+	}
+}
+
+struct BlockColor
+{
+	float r, g, b;
+};
+
+// RGB888 <-> RGB565 used for the block end points
+inline uint16_t packColor565(const BlockColor& c)
+{
+	int r = std::min(31, std::max(0, (int)std::lround(c.r * 31.0f / 255.0f)));
+	int g = std::min(63, std::max(0, (int)std::lround(c.g * 63.0f / 255.0f)));
+	int b = std::min(31, std::max(0, (int)std::lround(c.b * 31.0f / 255.0f)));
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline BlockColor unpackColor565(uint16_t c)
+{
+	BlockColor color;
+	color.r = (float)((c >> 11) & 31) * 255.0f / 31.0f;
+	color.g = (float)((c >> 5) & 63) * 255.0f / 63.0f;
+	color.b = (float)(c & 31) * 255.0f / 31.0f;
+	return color;
+}
+
+inline float colorDistance(const BlockColor& a, const BlockColor& b)
+{
+	float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+	return dr * dr + dg * dg + db * db;
+}
+
+// Compress one 4x4 block of RGBA pixels into an 8 byte BC1 color block.
+// End points are the extremes of the pixels along their principal axis, pulled in slightly.
+inline void compressColorBlock(const unsigned char pixels[16][4], unsigned char* out)
+{
+	BlockColor colors[16];
+	BlockColor mean = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		colors[i].r = pixels[i][0];
+		colors[i].g = pixels[i][1];
+		colors[i].b = pixels[i][2];
+		mean.r += colors[i].r / 16.0f;
+		mean.g += colors[i].g / 16.0f;
+		mean.b += colors[i].b / 16.0f;
+	}
+
+	// covariance matrix, then a few power iterations for the principal axis
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float r = colors[i].r - mean.r, g = colors[i].g - mean.g, b = colors[i].b - mean.b;
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = std::sqrt(x * x + y * y + z * z);
+		if (length < 1e-6f)
+			break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float p = (colors[i].r - mean.r) * axis[0] + (colors[i].g - mean.g) * axis[1] + (colors[i].b - mean.b) * axis[2];
+		minProjection = std::min(minProjection, p);
+		maxProjection = std::max(maxProjection, p);
+	}
+	// inset by 1/16 of the range so the interpolated colors land on the pixels rather than past them
+	float inset = (maxProjection - minProjection) / 16.0f;
+	minProjection += inset;
+	maxProjection -= inset;
+
+	BlockColor maxColor = { mean.r + axis[0] * maxProjection, mean.g + axis[1] * maxProjection, mean.b + axis[2] * maxProjection };
+	BlockColor minColor = { mean.r + axis[0] * minProjection, mean.g + axis[1] * minProjection, mean.b + axis[2] * minProjection };
+	uint16_t c0 = packColor565(maxColor);
+	uint16_t c1 = packColor565(minColor);
+
+	// c0 > c1 selects the 4 color mode, equal end points mean a solid block
+	if (c0 < c1)
+		std::swap(c0, c1);
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		BlockColor palette[4];
+		palette[0] = unpackColor565(c0);
+		palette[1] = unpackColor565(c1);
+		palette[2].r = (2.0f * palette[0].r + palette[1].r) / 3.0f;
+		palette[2].g = (2.0f * palette[0].g + palette[1].g) / 3.0f;
+		palette[2].b = (2.0f * palette[0].b + palette[1].b) / 3.0f;
+		palette[3].r = (palette[0].r + 2.0f * palette[1].r) / 3.0f;
+		palette[3].g = (palette[0].g + 2.0f * palette[1].g) / 3.0f;
+		palette[3].b = (palette[0].b + 2.0f * palette[1].b) / 3.0f;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestDistance = colorDistance(colors[i], palette[0]);
+			for (int p = 1; p < 4; p++)
+			{
+				float distance = colorDistance(colors[i], palette[p]);
+				if (distance < bestDistance)
+				{
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= (uint32_t)best << (2 * i);
+		}
+	}
+
+	out[0] = (unsigned char)(c0 & 0xff);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xff);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)((indices >> (8 * i)) & 0xff);
+}
+
+// Compress a whole RGBA level, edge blocks repeat the last row / column
+inline std::vector<unsigned char> compressLevel(const std::vector<unsigned char>& rgba, int width, int height)
+{
+	uint32_t blockBytes = getCompressedBlockBytes(CTEX_FORMAT_BC1);
+	std::vector<unsigned char> out(getCompressedLevelSize(CTEX_FORMAT_BC1, width, height));
+	size_t outOffset = 0;
+
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			unsigned char block[16][4];
+			for (int y = 0; y < 4; y++)
+			{
+				for (int x = 0; x < 4; x++)
+				{
+					int px = std::min(bx + x, width - 1);
+					int py = std::min(by + y, height - 1);
+					std::memcpy(block[y * 4 + x], &rgba[((size_t)py * width + px) * 4], 4);
+				}
+			}
+
+			compressColorBlock(block, &out[outOffset]);
+			outOffset += blockBytes;
+		}
+	}
+	return out;
+}
+
+// 2x2 box filter down to the next mip level
+inline std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height, int& newWidth, int& newHeight)
+{
+	newWidth = std::max(1, width / 2);
+	newHeight = std::max(1, height / 2);
+	std::vector<unsigned char> out((size_t)newWidth * newHeight * 4);
+
+	for (int y = 0; y < newHeight; y++)
+	{
+		for (int x = 0; x < newWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+					+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+				out[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return out;
+}
+
+// Full mip chain of an RGBA image down to 1x1, each level BC1 compressed if compress is set and
+// left RGBA otherwise. The levels' offsets are left 0, they depend on where the data goes.
+inline void buildMipChain(std::vector<unsigned char> rgba, int width, int height, bool compress,
+	std::vector<CompressedMipLevel>& levels, std::vector<std::vector<unsigned char>>& levelData)
+{
+	levels.clear();
+	levelData.clear();
+	for (;;)
+	{
+		levelData.push_back(compress ? compressLevel(rgba, width, height) : rgba);
+		CompressedMipLevel level = { (uint32_t)width, (uint32_t)height, 0, (uint32_t)levelData.back().size() };
+		levels.push_back(level);
+		if (width == 1 && height == 1)
+			break;
+
+		int nextWidth, nextHeight;
+		rgba = downsample(rgba, width, height, nextWidth, nextHeight);
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+#endif
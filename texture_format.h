@@ -0,0 +1,162 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Baked texture container (.ctex) written by texture_baker.cpp and read by TextureLoader into a
+// layer of the material TextureArray. Layout: header, one CompressedMipLevel entry per level,
+// then the block compressed level data. Every level starts on a 16 byte boundary so it can be
+// handed to the GL as is.
+
+// Width and height of every material layer. The baker writes this size, images of other sizes
+// are resampled to it.
+const int MATERIAL_LAYER_SIZE = 1024;
+
+const char CTEX_MAGIC[4] = { 'C', 'T', 'E', 'X' };
+const uint32_t CTEX_VERSION = 1;
+
+// Block format, the material layers only need RGB
+const uint32_t CTEX_FORMAT_BC1 = 1;	// RGB, 8 bytes per 4x4 block
+
+// Header flags
+const uint32_t CTEX_FLAG_FLIPPED = 1;	// rows are stored bottom row first
+
+struct CompressedTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct CompressedMipLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t offset;	// from the start of the file
+	uint32_t size;
+};
+
+struct CompressedTexture
+{
+	CompressedTextureHeader header;
+	std::vector<CompressedMipLevel> levels;
+	std::vector<unsigned char> data;	// the whole file, level offsets index into it
+};
+
+// 0 for a format we do not know
+inline uint32_t getCompressedBlockBytes(uint32_t format)
+{
+	return format == CTEX_FORMAT_BC1 ? 8 : 0;
+}
+
+inline uint32_t getCompressedLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+	return ((width + 3) / 4) * ((height + 3) / 4) * getCompressedBlockBytes(format);
+}
+
+// Baked files live next to their source image with the extension swapped, images/table.jpg -> images/table.ctex
+inline std::string getBakedTexturePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return sourcePath + ".ctex";
+	return sourcePath.substr(0, dot) + ".ctex";
+}
+
+// Read and validate a .ctex file, returns false if it is missing or malformed
+inline bool readCompressedTexture(const char* path, CompressedTexture& texture)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (fileSize < (long)sizeof(CompressedTextureHeader))
+	{
+		fclose(file);
+		return false;
+	}
+
+	texture.data.resize(fileSize);
+	size_t read = fread(texture.data.data(), 1, fileSize, file);
+	fclose(file);
+	if (read != (size_t)fileSize)
+		return false;
+
+	std::memcpy(&texture.header, texture.data.data(), sizeof(CompressedTextureHeader));
+	const CompressedTextureHeader& header = texture.header;
+	if (std::memcmp(header.magic, CTEX_MAGIC, 4) != 0 || header.version != CTEX_VERSION)
+		return false;
+	if (header.format != CTEX_FORMAT_BC1)
+		return false;
+
+	size_t tableEnd = sizeof(CompressedTextureHeader) + header.mipCount * sizeof(CompressedMipLevel);
+	if (header.mipCount == 0 || tableEnd > (size_t)fileSize)
+		return false;
+
+	texture.levels.resize(header.mipCount);
+	std::memcpy(texture.levels.data(), texture.data.data() + sizeof(CompressedTextureHeader), header.mipCount * sizeof(CompressedMipLevel));
+	for (const CompressedMipLevel& level : texture.levels)
+	{
+		if ((size_t)level.offset + level.size > (size_t)fileSize)
+			return false;
+	}
+	return true;
+}
+
+// Write a .ctex file from already compressed levels
+inline bool writeCompressedTexture(const char* path, uint32_t format, uint32_t flags, const std::vector<CompressedMipLevel>& levels, const std::vector<std::vector<unsigned char>>& levelData)
+{
+	CompressedTextureHeader header;
+	std::memcpy(header.magic, CTEX_MAGIC, 4);
+	header.version = CTEX_VERSION;
+	header.format = format;
+	header.width = levels[0].width;
+	header.height = levels[0].height;
+	header.mipCount = (uint32_t)levels.size();
+	header.flags = flags;
+	header.reserved = 0;
+
+	// lay the levels out after the table, each aligned to 16 bytes
+	std::vector<CompressedMipLevel> table = levels;
+	uint32_t offset = (uint32_t)(sizeof(CompressedTextureHeader) + table.size() * sizeof(CompressedMipLevel));
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		offset = (offset + 15) & ~15u;
+		table[i].offset = offset;
+		table[i].size = (uint32_t)levelData[i].size();
+		offset += table[i].size;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	const unsigned char zeros[16] = { 0 };
+	size_t written = sizeof(CompressedTextureHeader) + table.size() * sizeof(CompressedMipLevel);
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(table.data(), sizeof(CompressedMipLevel), table.size(), file);
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		fwrite(zeros, 1, table[i].offset - written, file);
+		fwrite(levelData[i].data(), 1, levelData[i].size(), file);
+		written = table[i].offset + table[i].size;
+	}
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+// Source.cpp includes stb_image.h with STB_IMAGE_IMPLEMENTATION, only pull in the declarations once
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image_flip.h"
+#include "job_system.h"
+#include "texture_array.h"
+#include "texture_compress.h"
+#include "texture_format.h"
+
+// Streams the material textures into the layers of a TextureArray in the background.
+// loadLayer() returns right away, the layer shows its placeholder until update() (called on the
+// GL thread, once per frame) has uploaded the mip chain a background job prepared for it.
+// A baked .ctex file (see texture_baker.cpp) next to the image is used as is when it matches
+// the array: BC1, the layer size and the row order we render with. Otherwise the job decodes
+// the image, resamples it to the layer size and builds the mips, compressing them for a BC1
+// array. With flipImages off the images are uploaded top row first and the shaders flip V instead.
+class TextureLoader
+{
+public:
+	// jobs has to outlive the loader
+	TextureLoader(JobSystem& jobs, int numPixelBuffers = 2, bool flipImages = true) : jobs(jobs), flipImages(flipImages)
+	{
+		pixelBuffers.resize(numPixelBuffers);
+		glGenBuffers(numPixelBuffers, pixelBuffers.data());
+	}
+
+	~TextureLoader()
+	{
+		// jobs that have not started yet return right away
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobs.wait(decoding);
+		glDeleteBuffers((GLsizei)pixelBuffers.size(), pixelBuffers.data());
+	}
+
+	// Queue an image file for a layer of array, which has to outlive the loader
+	void loadLayer(TextureArray& array, int layer, const char* path)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending++;
+		}
+		Job job = { &array, layer, path };
+		jobs.runInBackground(decoding, [this, job]() { decode(job); });
+	}
+
+	// Upload up to maxUploads prepared layers, call from the GL thread. Returns how many were uploaded.
+	int update(int maxUploads = 2)
+	{
+		int uploaded = 0;
+		while (uploaded < maxUploads)
+		{
+			DecodedLayer layer;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (decoded.empty())
+					break;
+				layer = std::move(decoded.front());
+				decoded.pop_front();
+			}
+
+			if (!layer.levels.empty())
+				uploadLayer(layer);
+			else
+				std::cout << "Texture failed to load at path: " << layer.path << std::endl;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending--;
+			}
+			uploaded++;
+		}
+		return uploaded;
+	}
+
+	// Block until every queued texture is decoded and uploaded
+	void finish()
+	{
+		while (getPending() > 0)
+		{
+			if (update(1) == 0)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				imageDecoded.wait(lock, [this]() { return !decoded.empty(); });
+			}
+		}
+	}
+
+	// Whether images are flipped on load, if not texture coordinates have to be flipped
+	bool flipsImages() const { return flipImages; }
+
+	// Textures that are still showing their placeholder
+	int getPending()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pending;
+	}
+
+private:
+	struct Job
+	{
+		TextureArray* array;
+		int layer;
+		std::string path;
+	};
+
+	// A layer's mip chain in the array's format, levels index into data. No levels if the
+	// image could not be read.
+	struct DecodedLayer
+	{
+		TextureArray* array;
+		int layer;
+		std::string path;
+		std::vector<CompressedMipLevel> levels;
+		std::vector<unsigned char> data;
+	};
+
+	JobSystem& jobs;
+	JobCounter decoding;
+	std::mutex mutex;
+	std::condition_variable imageDecoded;
+	std::deque<DecodedLayer> decoded;
+	int pending = 0;
+	bool stopping = false;
+	bool flipImages;
+
+	std::vector<GLuint> pixelBuffers;
+	size_t nextPixelBuffer = 0;
+
+	// Background job: read the baked file or decode the image off the GL thread
+	void decode(const Job& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+				return;
+		}
+
+		DecodedLayer layer;
+		layer.array = job.array;
+		layer.layer = job.layer;
+		layer.path = job.path;
+		if (!readBaked(layer))
+			decodeImage(layer);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(std::move(layer));
+		}
+		imageDecoded.notify_all();
+	}
+
+	// The baked file of the layer's image, if there is one that fits the array as it is
+	bool readBaked(DecodedLayer& layer) const
+	{
+		const TextureArray& array = *layer.array;
+		CompressedTexture baked;
+		if (!array.isCompressed() || !readCompressedTexture(getBakedTexturePath(layer.path).c_str(), baked))
+			return false;
+		bool bakedFlipped = (baked.header.flags & CTEX_FLAG_FLIPPED) != 0;
+		if (bakedFlipped != flipImages || (int)baked.levels.size() != array.getLevelCount())
+			return false;
+		for (size_t i = 0; i < baked.levels.size(); i++)
+		{
+			const CompressedMipLevel& level = baked.levels[i];
+			if ((int)level.width != array.getLevelWidth((int)i) || (int)level.height != array.getLevelHeight((int)i)
+				|| level.size != array.getLevelSize((int)i))
+				return false;
+		}
+		layer.levels = baked.levels;
+		layer.data = std::move(baked.data);
+		return true;
+	}
+
+	// No usable baked file: decode, flip, resample to the layer size and build the mips
+	void decodeImage(DecodedLayer& layer) const
+	{
+		const TextureArray& array = *layer.array;
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(layer.path.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+			return;
+		// the jobs already run one image each, so the single threaded flip is used here
+		if (flipImages)
+			flipImageVertically(pixels, width, height, 4);
+		std::vector<unsigned char> rgba((size_t)array.getWidth() * array.getHeight() * 4);
+		resizeImage(pixels, width, height, 4, rgba.data(), array.getWidth(), array.getHeight());
+		stbi_image_free(pixels);
+
+		std::vector<std::vector<unsigned char>> levelData;
+		buildMipChain(std::move(rgba), array.getWidth(), array.getHeight(), array.isCompressed(), layer.levels, levelData);
+		for (size_t i = 0; i < levelData.size(); i++)
+		{
+			layer.levels[i].offset = (uint32_t)layer.data.size();
+			layer.data.insert(layer.data.end(), levelData[i].begin(), levelData[i].end());
+		}
+	}
+
+	// The levels are back to back, so the whole chain goes to the driver through one pixel buffer
+	void uploadLayer(const DecodedLayer& layer)
+	{
+		size_t first = layer.levels.front().offset;
+		size_t size = layer.levels.back().offset + layer.levels.back().size - first;
+		GLuint pixelBuffer = pixelBuffers[nextPixelBuffer];
+		nextPixelBuffer = (nextPixelBuffer + 1) % pixelBuffers.size();
+
+		// glBufferData orphans the previous contents, so we never wait on an upload still in flight
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, &layer.data[first], GL_STREAM_DRAW);
+		for (size_t i = 0; i < layer.levels.size(); i++)
+			layer.array->setLevel(layer.layer, (int)i, (void*)(layer.levels[i].offset - first));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+};
+
+#endif
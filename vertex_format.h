@@ -0,0 +1,103 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh_data.h"
+
+// How vertices are stored on the GPU
+enum Vertex_Format {
+	VERTEX_FORMAT_FLOAT,	// MESH_VERTEX_FLOATS floats, 32 bytes
+	VERTEX_FORMAT_PACKED	// PackedVertex, 16 bytes
+};
+
+// Attribute locations of the position decode (scale and offset) of a mesh, fed per instance
+// (see instancing.h). Packed positions are 0..1 across the mesh bounds and the vertex shaders
+// map them back with these.
+const unsigned int POSITION_SCALE_ATTRIBUTE = 8;
+const unsigned int POSITION_OFFSET_ATTRIBUTE = 9;
+
+// Quantized vertex: position as 16 bit unsigned normalized relative to the mesh bounds (the
+// fourth value pads to 4 byte alignment), normal as signed normalized 10_10_10_2 and the
+// texture coordinate as two half floats
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+	uint16_t texCoord[2];
+};
+
+// IEEE half float, rounded to nearest; values too large become infinity, too small zero
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7C00);
+	if (exponent <= 0)
+	{
+		// denormal or zero
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint16_t half = (uint16_t)(mantissa >> shift);
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return (uint16_t)(sign | half);
+	}
+	uint16_t half = (uint16_t)(sign | (exponent << 10) | (mantissa >> 13));
+	// a carry out of the mantissa correctly bumps the exponent
+	if (mantissa & 0x1000)
+		half++;
+	return half;
+}
+
+// Normal in GL_INT_2_10_10_10_REV layout: x in the low bits, w (unused) in the top two
+inline uint32_t packNormal(const glm::vec3& normal)
+{
+	uint32_t packed = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float component = std::fmin(std::fmax(normal[i], -1.0f), 1.0f);
+		int value = (int)std::lround(component * 511.0f);
+		packed |= ((uint32_t)value & 0x3FF) << (10 * i);
+	}
+	return packed;
+}
+
+// Pack interleaved float vertices. boundsMin/boundsMax must contain every position; scale and
+// offset receive the decode, position = packed * scale + offset.
+inline void packVertices(const float* vertices, size_t vertexCount, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	std::vector<PackedVertex>& packed, glm::vec3& scale, glm::vec3& offset)
+{
+	offset = boundsMin;
+	scale = boundsMax - boundsMin;
+	packed.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const float* vertex = vertices + i * MESH_VERTEX_FLOATS;
+		PackedVertex& out = packed[i];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// flat axes (the plane's y) decode to the offset alone
+			float t = scale[axis] > 0.0f ? (vertex[axis] - offset[axis]) / scale[axis] : 0.0f;
+			out.position[axis] = (uint16_t)std::lround(std::fmin(std::fmax(t, 0.0f), 1.0f) * 65535.0f);
+		}
+		out.position[3] = 0;
+		out.normal = packNormal(glm::vec3(vertex[3], vertex[4], vertex[5]));
+		out.texCoord[0] = floatToHalf(vertex[6]);
+		out.texCoord[1] = floatToHalf(vertex[7]);
+	}
+}
+
+#endif